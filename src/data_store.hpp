@@ -9,6 +9,8 @@
 #include <set>
 #include <map>
 
+#include "paths_file.hpp"
+
 using namespace std;
 
 // assuming that all simulations run for 24 hours
@@ -38,7 +40,6 @@ struct edge_info {
   int id, u, v;
   char type;
   int capacity, latency;
-  vector<int> paths; // path-ids that include this edge
   edge_info(int id = -1, int u = -1, int v = -1, 
       char t = 'i', int c = -1, int l = -1) :
     id(id), u(u), v(v), type(t), capacity(c), latency(l) {
@@ -104,14 +105,16 @@ struct data_store {
   // it is used to track delay and bandwidth usage and
   // convert path -> (u, v) to path -> edge-id
   vector<edge_info> edges;
-  map<pair<int, int>, int> edge_uv_to_id;
   // path to node and switch & edge to path mappings
-  // these are used for the constraints in the cplex model
-  std::vector<std::vector<int>> path_nodes;
-  std::vector<std::vector<int>> path_switches;
-  std::vector<std::vector<int>> path_edge_ids;
-  vector<vector<int>> edge_id_to_paths;
-  std::unordered_map<int, vector<int>> switch_to_paths;
+  // these are used for the constraints in the cplex model. Edges are
+  // referred to by their index in edges, switch_to_paths is indexed by
+  // node id. The rows point into path_file if paths.bin was read.
+  int_rows path_nodes;
+  int_rows path_switches;
+  int_rows path_edge_ids;
+  int_rows edge_id_to_paths;
+  int_rows switch_to_paths;
+  mapped_file path_file;
   // co to server, switch, edge mapping
   std::vector<std::vector<int>> co_server_ids;
   std::vector<std::vector<int>> co_switch_ids;
@@ -125,6 +128,7 @@ struct data_store {
   // functions to read specific files
   void read_res_topology_data(const string& filename);
   void read_path_data(const string& filename);
+  void map_path_data(const string& filename);
     void read_n_sfc_data(const std::string& n_sfc_filename,
         sfc_request_set& n_sfcs);
     void read_x_sfc_data(const std::string& x_sfc_filename,
@@ -136,7 +140,7 @@ void data_store::read_input(int argc, char **argv) {
   // check args for correct format
   if (argc != 3) {
     cout << "usage: ./esso_cplex.o <path-to res_topology.dat> " <<
-      "<path-to paths.dat>" << endl;
+      "<path-to paths.dat or paths.bin>" << endl;
     exit(-1);
   }
   // filenames for reading in the inputs
@@ -214,50 +218,129 @@ void data_store::read_res_topology_data(const string& filename) {
     fin >> id >> node_u >> node_v >> type >> co_id >> capacity >> latency;
     if (type == 'i') co_edge_ids[co_id].push_back(id);
     else backbone_edge_ids.push_back(id);
-    edge_uv_to_id.insert(make_pair(make_pair(node_u, node_v), edges.size()));
     edges.emplace_back(id, node_u, node_v, type, capacity, latency);
   }
   fin.close();
 }
 
+// paths.bin, written by process_topology.o, is mapped instead of parsed
 void data_store::read_path_data(const string& filename) {
+  if (is_paths_file(filename)) {
+    map_path_data(filename);
+    return;
+  }
   fstream fin(filename);
   if (!fin) {
     cerr << "Failed to open paths.dat" << endl;
     exit(-1);
   }
+  map<pair<int, int>, int> edge_uv_to_id;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    edge_uv_to_id.insert(make_pair(make_pair(edges[i].u, edges[i].v), i));
+  }
   fin >> path_count;
-  // resize the vectors
-  path_nodes.resize(path_count, vector<int>());
-  path_switches.resize(path_count, vector<int>());
-  path_edge_ids.resize(path_count);
+  vector<int32_t> node_offsets{0}, node_values;
+  vector<int32_t> edge_offsets{0}, edge_values;
+  vector<int32_t> switch_offsets{0}, switch_values;
   // read data
   int id, n, u, v;
   for (int i = 0; i < path_count; ++i) {
     fin >> id >> n >> u;
-    path_nodes[i].push_back(u);
+    node_values.push_back(u);
     for (int j = 1; j < n; ++j) {
       fin >> v;
-      path_nodes[i].push_back(v);
+      node_values.push_back(v);
       auto edge_itr = edge_uv_to_id.find(make_pair(u, v)); 
       // this check is needed for skipping server loops
       // if they are added to the res_topology file then 
       // this must be removed
       if (edge_itr != edge_uv_to_id.end()) {
-        auto& edge = edges[edge_itr->second];
-        edge.paths.push_back(i);
-        path_edge_ids[i].push_back(edge.id);
+        edge_values.push_back(edge_itr->second);
       }
       u = v;
     }
     fin >> n; // switch-count
-    path_switches[i].resize(n);
-    for (auto& s : path_switches[i]) {
-      fin >> s;
-      switch_to_paths[s].push_back(i);
+    for (int j = 0; j < n; ++j) {
+      fin >> v;
+      switch_values.push_back(v);
     }
+    node_offsets.push_back(node_values.size());
+    edge_offsets.push_back(edge_values.size());
+    switch_offsets.push_back(switch_values.size());
   }
   fin.close();
+  path_nodes.assign(move(node_offsets), move(node_values));
+  path_edge_ids.assign(move(edge_offsets), move(edge_values));
+  path_switches.assign(move(switch_offsets), move(switch_values));
+  path_edge_ids.invert(edge_count, edge_id_to_paths);
+  path_switches.invert(node_count, switch_to_paths);
+}
+
+// the node and edge tables of paths.bin are only checked against
+// res_topology.dat, which has the current capacities and powers
+void data_store::map_path_data(const string& filename) {
+  auto fail = [&filename](const string& reason) {
+    cerr << "Failed to read " << filename << ": " << reason << endl;
+    exit(-1);
+  };
+  if (!path_file.open(filename)) fail("cannot map the file");
+  const char* base = path_file.data();
+  auto size = path_file.size();
+  if (size < sizeof(paths_file_header)) fail("truncated header");
+  paths_file_header header;
+  memcpy(&header, base, sizeof(header));
+  if (header.version != paths_file_version) fail("unsupported version");
+  if (header.byte_order != paths_file_byte_order) fail("wrong byte order");
+  if (header.node_count != node_count || header.edge_count != edge_count) {
+    fail("topology does not match res_topology.dat");
+  }
+  if (header.path_count < 0) fail("negative path count");
+  auto in_file = [size](uint64_t offset, uint64_t bytes) {
+    return offset % 8 == 0 && offset <= size && bytes <= size - offset;
+  };
+  if (!in_file(header.nodes, node_count * sizeof(paths_file_node))) {
+    fail("truncated node table");
+  }
+  auto file_nodes = reinterpret_cast<const paths_file_node*>(
+      base + header.nodes);
+  if (node_infos.size() != static_cast<size_t>(node_count)) {
+    fail("topology does not match res_topology.dat");
+  }
+  for (int i = 0; i < node_count; ++i) {
+    if (file_nodes[i].node_id != node_infos[i].node_id ||
+        file_nodes[i].co_id != node_infos[i].co_id ||
+        file_nodes[i].node_category != node_infos[i].node_category) {
+      fail("topology does not match res_topology.dat");
+    }
+  }
+  if (!in_file(header.edges, edge_count * sizeof(paths_file_edge))) {
+    fail("truncated edge table");
+  }
+  auto file_edges = reinterpret_cast<const paths_file_edge*>(
+      base + header.edges);
+  for (int i = 0; i < edge_count; ++i) {
+    if (file_edges[i].u != edges[i].u || file_edges[i].v != edges[i].v) {
+      fail("topology does not match res_topology.dat");
+    }
+  }
+  path_count = header.path_count;
+  auto map_csr = [&](const paths_file_csr& csr, int rows, int_rows& target) {
+    if (!in_file(csr.offsets, (rows + 1) * sizeof(int32_t)) ||
+        !in_file(csr.values, csr.value_count * sizeof(int32_t))) {
+      fail("truncated section");
+    }
+    auto offsets = reinterpret_cast<const int32_t*>(base + csr.offsets);
+    if (offsets[0] != 0 || uint64_t(offsets[rows]) != csr.value_count) {
+      fail("corrupt section");
+    }
+    target.map(offsets, reinterpret_cast<const int32_t*>(base + csr.values),
+        rows);
+  };
+  map_csr(header.path_nodes, path_count, path_nodes);
+  map_csr(header.path_edges, path_count, path_edge_ids);
+  map_csr(header.path_switches, path_count, path_switches);
+  map_csr(header.edge_paths, edge_count, edge_id_to_paths);
+  map_csr(header.switch_paths, node_count, switch_to_paths);
 }
 
 void data_store::read_n_sfc_data(const string& n_sfc_filename,
@@ -299,14 +382,8 @@ void data_store::read_x_sfc_data(const string& x_sfc_filename,
 }
 
 int data_store::path_latency(int _p) {
-  int latency{0}, u{path_nodes[_p].front()}, v;
-  for (size_t i = 1; i < path_nodes[_p].size(); ++i) {
-    v = path_nodes[_p].at(i);
-    if (u == v) continue;
-    auto edge_id = edge_uv_to_id[make_pair(u, v)];
-    latency += edges[edge_id].latency;
-    u = v;
-  }
+  int latency{0};
+  for (int _l : path_edge_ids[_p]) latency += edges[_l].latency;
   return latency;
 }
 
@@ -0,0 +1,258 @@
+#ifndef ESSO_BATCH_HPP_
+#define ESSO_BATCH_HPP_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "esso_heuristic.hpp"
+
+// order in which the sfcs of one timeslot are embedded
+enum class batch_order {
+  arrival,                // as listed in timeslots.dat
+  largest_cpu_first,      // total cpu demand, descending
+  tightest_latency_first  // latency bound, ascending
+};
+
+bool parse_batch_order(const std::string& name, batch_order& order) {
+  if (name == "arrival") order = batch_order::arrival;
+  else if (name == "cpu") order = batch_order::largest_cpu_first;
+  else if (name == "latency") order = batch_order::tightest_latency_first;
+  else return false;
+  return true;
+}
+
+// Stage-2 tables of one co for one (cpu profile, bandwidth), computed
+// at the given version of the co
+struct co_cost_table {
+  unsigned version;
+  std::vector<std::vector<double>> cost_matrix;
+  std::vector<std::vector<int>> node_matrix;
+};
+
+// outcome of one sfc of a batch, mapping is committed if embedded is set
+struct batch_embedding {
+  const sfc_request* sfc{nullptr};
+  bool embedded{false};
+  double time{0.0};
+  std::vector<int> emb_nodes;
+  sfc_mapping mapping;
+};
+
+// work shared by the sfcs of one timeslot. Path sets come from the ksp
+// cache per (ingress co, egress co, bandwidth class), so they are only
+// recomputed when a commit or release changes which links have the
+// class bandwidth. The searches of a class only scan the capacity view
+// of its bandwidth, registered once per batch and dropped with it. The
+// committed backbone legs come from the shortest path trees of the spt
+// cache. Stage-2 tables are kept per co and (cpu profile,
+// bandwidth) and are recomputed once a commit changed the version of
+// the co. With the green_front source the paths of an sfc are its own
+// Stage-1 front instead.
+struct embedding_batch {
+  problem_instance& prob_inst;
+  const int timeslot;
+  const int k;
+  const bool use_tabu;
+  const path_source source;
+
+  izlib::iz_ksp_cache& ksp_cache;
+  izlib::iz_spt_cache& spt_cache;
+  std::vector<std::map<std::pair<std::vector<int>, int>, co_cost_table>>
+      cost_tables;
+  // bandwidth classes whose capacity view this batch registered
+  std::set<int> view_classes;
+
+  embedding_batch(problem_instance& prob_inst, const int timeslot,
+      const int k, const bool use_tabu, izlib::iz_ksp_cache& ksp_cache,
+      izlib::iz_spt_cache& spt_cache,
+      const path_source source = path_source::shortest) :
+      prob_inst(prob_inst), timeslot(timeslot), k(k), use_tabu(use_tabu),
+      source(source), ksp_cache(ksp_cache), spt_cache(spt_cache),
+      cost_tables(prob_inst.topology.cos.size()) {}
+  embedding_batch(const embedding_batch&) = delete;
+  ~embedding_batch() {
+    for (auto class_bw : view_classes) {
+      prob_inst.topology.inter_co_topo.remove_capacity_view(class_bw);
+    }
+  }
+
+  // the bandwidth classes are powers of two, a path set is computed for
+  // the lower end of the class and shared by every sfc in it
+  // paths of a group scanned per sfc, in multiples of k
+  static const int class_scan_limit = 4;
+
+  static int class_bandwidth(const int bandwidth) {
+    if (bandwidth < 1) return 0;
+    int class_bw = 1;
+    while (class_bw <= bandwidth / 2) class_bw *= 2;
+    return class_bw;
+  }
+
+  // registers the capacity views of the bandwidth classes of sfcs
+  void add_class_views(const std::vector<const sfc_request*>& sfcs) {
+    auto& inter_co_topo = prob_inst.topology.inter_co_topo;
+    for (auto sfc : sfcs) {
+      int class_bw = class_bandwidth(sfc->bandwidth);
+      if (!view_classes.count(class_bw) &&
+          inter_co_topo.add_capacity_view(class_bw)) {
+        view_classes.insert(class_bw);
+      }
+    }
+  }
+
+  // fills paths with the k shortest paths that have enough residual
+  // bandwidth for this sfc and meet its latency bound, the same ones a
+  // search at its own bandwidth returns. They are taken from the shared
+  // path set of the sfc's group, past its first k paths if some of them
+  // are too narrow. The group's paths are in order of latency, so the
+  // scan stops at the first one over the bound. If the group still has
+  // too few after class_scan_limit paths the sfc gets the paths of its
+  // own bandwidth, so a narrow group is never enumerated.
+  void candidate_paths(const sfc_request& sfc, izlib::iz_path_list& paths) {
+    auto& inter_co_topo = prob_inst.topology.inter_co_topo;
+    int class_bw = class_bandwidth(sfc.bandwidth);
+    auto& ksp = ksp_cache.paths(sfc.ingress_co, sfc.egress_co, class_bw);
+    paths.clear();
+    izlib::iz_path path;
+    int i{0};
+    for (; static_cast<int>(paths.size()) < k && i < class_scan_limit * k;
+        ++i) {
+      if (!ksp.path_at(i, path) || path.latency > sfc.latency) return;
+      inter_co_topo.update_path_metrics(path);
+      if (path.capacity >= sfc.bandwidth) paths.push_back(path);
+    }
+    if (static_cast<int>(paths.size()) == k) return;
+    auto& own_ksp = ksp_cache.paths(sfc.ingress_co, sfc.egress_co,
+        int(sfc.bandwidth));
+    paths.clear();
+    for (int j = 0; j < k && own_ksp.path_at(j, path) &&
+        path.latency <= sfc.latency; ++j) {
+      inter_co_topo.update_path_metrics(path);
+      paths.push_back(path);
+    }
+  }
+
+  // fills paths with the first k paths of the Stage-1 front of the sfc
+  void green_paths(const sfc_request& sfc, izlib::iz_path_list& paths) {
+    stage_one_paths(sfc, timeslot, prob_inst, paths);
+    if (paths.size() > static_cast<size_t>(k)) paths.resize(k);
+    for (auto& path : paths) {
+      prob_inst.topology.inter_co_topo.update_path_metrics(path);
+    }
+  }
+
+  // only touches the tables of co_id, so it can be called concurrently
+  // for different cos
+  const co_cost_table& cost_table(const int co_id, const sfc_request& sfc) {
+    const auto& co = prob_inst.topology.cos[co_id];
+    auto key = std::make_pair(sfc.cpu_reqs, int(sfc.bandwidth));
+    auto& table = cost_tables[co_id][key];
+    if (table.cost_matrix.empty() || table.version != co.version) {
+      table.version = co.version;
+      table.cost_matrix.clear();
+      table.node_matrix.clear();
+      co.compute_embedding_cost(sfc.cpu_reqs, sfc.bandwidth, timeslot,
+          table.cost_matrix, table.node_matrix);
+    }
+    return table;
+  }
+
+  bool embed(const sfc_request& sfc, batch_embedding& result) {
+    result.sfc = &sfc;
+    result.embedded = false;
+
+    izlib::iz_path_list paths;
+    // no path meets the latency bound, whatever the residuals are
+    if (prob_inst.topology.backbone_latency(sfc.ingress_co, sfc.egress_co) <=
+        sfc.latency) {
+      if (source == path_source::shortest) candidate_paths(sfc, paths);
+      else green_paths(sfc, paths);
+    }
+    if (paths.empty()) {
+      std::cerr << "no embedding path" << std::endl;
+      return false;
+    }
+    auto co_costs = [&](int co_id,
+        std::vector<std::vector<double>>& cost_matrix,
+        std::vector<std::vector<int>>& node_matrix) {
+      const auto& table = cost_table(co_id, sfc);
+      cost_matrix = table.cost_matrix;
+      node_matrix = table.node_matrix;
+    };
+
+    double brown_before, green_before;
+    double cost_before = prob_inst.topology.get_carbon_fp(timeslot,
+        brown_before, green_before);
+    std::vector<int> emb_cos, emb_co_nodes;
+    if (!search_embedding(prob_inst, sfc, paths, co_costs, result.emb_nodes,
+        emb_cos, emb_co_nodes, result.time, use_tabu) ||
+        !commit_embedding(prob_inst, sfc, emb_cos, emb_co_nodes,
+            result.mapping, &spt_cache)) {
+      return false;
+    }
+    result.mapping.timeslot = timeslot;
+    double brown_energy, green_energy;
+    result.mapping.cost = prob_inst.topology.get_carbon_fp(timeslot,
+        brown_energy, green_energy) - cost_before;
+    result.mapping.brown_energy = brown_energy - brown_before;
+    result.mapping.green_energy = green_energy - green_before;
+    result.embedded = true;
+    return true;
+  }
+};
+
+void order_batch(std::vector<const sfc_request*>& sfcs,
+    const batch_order order) {
+  auto total_cpu = [](const sfc_request* sfc) {
+    return std::accumulate(sfc->cpu_reqs.begin(), sfc->cpu_reqs.end(), 0);
+  };
+  switch (order) {
+    case batch_order::arrival:
+      break;
+    case batch_order::largest_cpu_first:
+      std::stable_sort(sfcs.begin(), sfcs.end(),
+          [&](const sfc_request* lhs, const sfc_request* rhs) {
+            return total_cpu(lhs) > total_cpu(rhs);
+          });
+      break;
+    case batch_order::tightest_latency_first:
+      std::stable_sort(sfcs.begin(), sfcs.end(),
+          [](const sfc_request* lhs, const sfc_request* rhs) {
+            return lhs->latency < rhs->latency;
+          });
+      break;
+  }
+}
+
+// embeds and commits all sfcs of one timeslot in the given order. The
+// results are returned in the order the sfcs were embedded. Path sets
+// and backbone trees are shared with other timeslots through ksp_cache
+// and spt_cache if they are given.
+std::vector<batch_embedding> embed_batch(problem_instance& prob_inst,
+    const sfc_request_set& sfcs, const int timeslot, const int k,
+    const batch_order order = batch_order::arrival,
+    const bool use_tabu = true, izlib::iz_ksp_cache* ksp_cache = nullptr,
+    izlib::iz_spt_cache* spt_cache = nullptr,
+    const path_source source = path_source::shortest) {
+  std::vector<const sfc_request*> queue;
+  for (auto& sfc : sfcs) queue.push_back(&sfc);
+  order_batch(queue, order);
+
+  izlib::iz_ksp_cache local_ksp_cache(prob_inst.topology.inter_co_topo);
+  izlib::iz_spt_cache local_spt_cache(prob_inst.topology.inter_co_topo);
+  embedding_batch batch(prob_inst, timeslot, k, use_tabu,
+      ksp_cache ? *ksp_cache : local_ksp_cache,
+      spt_cache ? *spt_cache : local_spt_cache, source);
+  if (source == path_source::shortest) batch.add_class_views(queue);
+  std::vector<batch_embedding> results(queue.size());
+  for (size_t i = 0; i < queue.size(); ++i) {
+    batch.embed(*queue[i], results[i]);
+  }
+  return results;
+}
+
+#endif
@@ -119,7 +119,7 @@ int main(int argc, char **argv) {
     // q[_l] whether a physical link is active or not
     for (int _l = 0; _l < ds.edge_count; ++_l) {
       IloExpr sum(env);
-      for (int _p : ds.edges[_l].paths) {
+      for (int _p : ds.edge_id_to_paths[_l]) {
         for (int l = 0; l < sfc.edge_count(); ++l) {
           sum += y[l][_p];
         }
@@ -144,12 +144,12 @@ int main(int argc, char **argv) {
     for (int _s = 0; _s < ds.node_count; ++_s) {
       // if not server, then its a switch
       if (!ds.node_infos[_s].is_server()) {
-        auto sw_paths = ds.switch_to_paths.find(_s);
-        if (sw_paths == ds.switch_to_paths.end()) {
+        auto sw_paths = ds.switch_to_paths[_s];
+        if (sw_paths.empty()) {
           continue;
         }
         IloExpr sum(env);
-        for (int _p : sw_paths->second) {
+        for (int _p : sw_paths) {
           for (int l = 0; l < sfc.edge_count(); ++l) {
             sum += y[l][_p];
           }
@@ -179,7 +179,7 @@ int main(int argc, char **argv) {
     for (int _l = 0; _l < ds.edge_count; ++_l) {
       IloExpr allocated_capacity(env);
       for (int l = 0; l < sfc.edge_count(); ++l) {
-        for (int _p: ds.edges[_l].paths) {
+        for (int _p: ds.edge_id_to_paths[_l]) {
           allocated_capacity += y[l][_p] * sfc.bandwidth;
         }
       }
@@ -428,7 +428,7 @@ int main(int argc, char **argv) {
     // output the co stretch
     cout << uniq_cos.size() << " ";
     // get value for y
-    vector<vector<int>> all_paths;
+    vector<int_rows::row> all_paths;
     for (int l = 0; l < sfc.edge_count(); ++l) {
       //cout << "y[" << l << "] = ";
       for (int _p = 0; _p < ds.path_count; ++_p) {
@@ -1,6 +1,7 @@
 #include <limits>
 #include <sstream>
 #include <set>
+#include <random>
 
 //#include "esso_heuristic.hpp"
 #include "iz_topology.hpp"
@@ -18,39 +19,27 @@ const char* join_path(string& dir, const string& file) {
   return (dir+file).c_str();
 }
 
-iz_path stage_one(const sfc_request& sfc, const int k, const int timeslot,
+// Stage-1: the path with the most residual green energy on the pareto
+// front of the paths that meet the latency bound and have enough residual
+// bandwidth
+iz_path stage_one(const sfc_request& sfc, const int timeslot,
     problem_instance& prob_inst) {
-  // find path set
-  iz_path_list paths;
-  auto& inter_co_topo = prob_inst.topology.inter_co_topo;
-  inter_co_topo.k_shortest_paths(sfc.ingress_co, sfc.egress_co, k, paths,
-      sfc.bandwidth);
-  
-  // find the path with max energy
-  int max_energy_path_index{-1};
-  double max_energy{-1.0};
   const auto& cos = prob_inst.topology.cos;
-  for (int i = 0; i < paths.size(); ++i) {
-    const auto& path = paths[i];
-    //cout << path << endl;
-    if (path.latency > sfc.latency) continue;
-    double path_energy{0.0};
-    for (auto& co_id : path.nodes) {
-      path_energy += cos[co_id].green_residual[timeslot];
-    }
-    if (path_energy > max_energy) {
-      max_energy_path_index = i;
-      max_energy = path_energy;
-    }
+  vector<double> green_residual(cos.size());
+  for (size_t i = 0; i < cos.size(); ++i) {
+    green_residual[i] = cos[i].green_residual[timeslot];
   }
-
-  // return either the path with max energy or
-  // return an empty path is all paths' latency
-  // is greater than the sfc's latency bound
-  iz_path path;
-  if (max_energy_path_index != -1)
-    path = move(paths[max_energy_path_index]);
-  return path;
+  iz_path_list front;
+  prob_inst.topology.inter_co_topo.pareto_paths(sfc.ingress_co,
+      sfc.egress_co, green_residual,
+      prob_inst.topology.backbone_latencies_to(sfc.egress_co), front,
+      sfc.bandwidth, sfc.latency);
+
+  // the front is ordered by latency and green energy, so the last path
+  // has the most green energy. An empty path is returned if no path
+  // meets the latency bound.
+  if (front.empty()) return iz_path();
+  return front.back();
 }
 
 void stage_two(const int co_id, const sfc_request& sfc, const iz_path& path, 
@@ -410,8 +399,7 @@ int main(int argc, char **argv) {
 
     /* commentedout this block to check for all paths instead of one
     // Stage-1: find a path for embedding sfc
-    int k = 3; // number of candidate paths
-    auto embedding_path = stage_one(sfc, k, timeslot, prob_inst);
+    auto embedding_path = stage_one(sfc, timeslot, prob_inst);
     // if no path found then 
     // OUTPUT 404 message
     if (!embedding_path.is_valid()) {
@@ -427,8 +415,9 @@ int main(int argc, char **argv) {
     iz_path embedding_path;
     int k = 2; // 10 alternate paths are explored here
     auto& inter_co_topo = prob_inst.topology.inter_co_topo;
+    // only the paths that meet the latency bound of the sfc
     inter_co_topo.k_shortest_paths(sfc.ingress_co, sfc.egress_co, k, paths,
-        sfc.bandwidth);
+        sfc.bandwidth, sfc.latency);
     if (paths.empty()) {
       print_404_message(sfc);
       cerr << "no embedding path" << endl;
@@ -455,7 +444,6 @@ int main(int argc, char **argv) {
     bool solution_found = false;
 
     for (auto& path : paths) {
-      if (path.latency > sfc.latency) continue;
       htimer.reset();
       // Stage-2: compute the cost matrix for all co's on the embedding path
       vector<vector<vector<double>>> cost_matrices(path.size());
@@ -605,7 +593,7 @@ int main(int argc, char **argv) {
         for (int v : same_co_nodes) {
           if (u == v) continue;
           iz_path path;
-          prob_inst.topology.cos[last_co].intra_topo.shortest_path(u, v,
+          prob_inst.topology.cos[last_co].shortest_path(u, v,
               path, sfc.bandwidth);
           if (!path.is_valid()) {
             print_404_message(sfc); 
@@ -617,7 +605,7 @@ int main(int argc, char **argv) {
           u = v;
         }
         iz_path path;
-        prob_inst.topology.cos[last_co].intra_topo.shortest_path(u, 0,
+        prob_inst.topology.cos[last_co].shortest_path(u, 0,
             path, sfc.bandwidth);
         if (!path.is_valid()) {
           print_404_message(sfc); 
@@ -637,7 +625,7 @@ int main(int argc, char **argv) {
       for (int v : same_co_nodes) {
         if (u == v) continue;
         iz_path path;
-        prob_inst.topology.cos[last_co].intra_topo.shortest_path(u, v,
+        prob_inst.topology.cos[last_co].shortest_path(u, v,
             path, sfc.bandwidth);
         if (!path.is_valid()) {
           print_404_message(sfc); 
@@ -649,7 +637,7 @@ int main(int argc, char **argv) {
         u = v;
       }
       iz_path path;
-      prob_inst.topology.cos[last_co].intra_topo.shortest_path(u, 0,
+      prob_inst.topology.cos[last_co].shortest_path(u, 0,
           path, sfc.bandwidth);
       if (!path.is_valid()) {
         print_404_message(sfc); 
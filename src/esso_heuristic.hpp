@@ -1,291 +1,1036 @@
 #ifndef ESSO_HEURISTIC_HPP_
 #define ESSO_HEURISTIC_HPP_
 
+#include <algorithm>
+#include <set>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <functional>
+#include <unordered_map>
+
 #include "iz_topology.hpp"
+#include "iz_ksp_cache.hpp"
+#include "iz_spt_cache.hpp"
 #include "problem_instance.hpp"
+#include "iz_timer.hpp"
+#include "iz_thread_pool.hpp"
 
-// Stage - 1: Find a path between the ingress and egress COs with maximum
-// aggregate green energy.
-std::unique_ptr<izlib::iz_path> GetPathWithMaxGreenEnergy(
-    problem_instance& p_instance, sfc_request& chain, int k, int ts) {
-  // the path that will be returned from this function
-  std::unique_ptr<izlib::iz_path> ret_path(new izlib::iz_path());
+// Stage-1 candidates: the pareto front of the paths that meet the
+// latency bound and have enough residual bandwidth, on residual green
+// energy and latency, greenest first. The front comes from pareto_paths
+// and is approximate, its first path is not always the greenest of all
+// those paths.
+void stage_one_paths(const sfc_request& sfc, const int timeslot,
+    problem_instance& prob_inst, izlib::iz_path_list& paths) {
+  const auto& cos = prob_inst.topology.cos;
+  std::vector<double> green_residual(cos.size());
+  for (size_t i = 0; i < cos.size(); ++i) {
+    green_residual[i] = cos[i].green_residual[timeslot];
+  }
+  prob_inst.topology.inter_co_topo.pareto_paths(sfc.ingress_co,
+      sfc.egress_co, green_residual,
+      prob_inst.topology.backbone_latencies_to(sfc.egress_co), paths,
+      sfc.bandwidth, sfc.latency);
+  // the front is ordered by latency and so by green energy as well
+  std::reverse(paths.begin(), paths.end());
+}
 
-  // Compute k-Shortest path between the ingress and egress CO of the chain.
-  // iz_path_list paths will contain k paths, we will iterate over them
-  // and select the path with the maximum green energy
+// Stage-1: the path with the most residual green energy among the paths
+// that meet the latency bound and have enough residual bandwidth, as far
+// as stage_one_paths finds it. An empty path is returned if no path
+// meets the latency bound.
+izlib::iz_path stage_one(const sfc_request& sfc, const int timeslot,
+    problem_instance& prob_inst) {
   izlib::iz_path_list paths;
-  auto& inter_co_topo = p_instance.topology.inter_co_topo;
-  inter_co_topo.k_shortest_paths(chain.ingress_co, chain.egress_co, k, paths,
-                                 chain.bandwidth);
-
-  // For each computed path, compute the aggregate amount of green energy
-  // available on the COs.
-  auto& cos = p_instance.topology.cos;
-  double max_avail_green = -1.0;
-  int max_path_index = -1;
-  for (int i = 0; i < paths.size(); ++i) {
-    auto& path = paths[i];
-    // if the path's letency is greater than the max-latency of the
-    // chain, then we skip this path as it does not satisfy latency
-    // constraint
-    if (path.latency > chain.latency) continue;
-    double total_avail_green = 0.0;
-    for (auto co_id : path.nodes) {
-      total_avail_green += cos[co_id].green_residual[ts];
-    }
-    if (total_avail_green > max_avail_green) {
-      max_avail_green = total_avail_green;
-      max_path_index = i;
+  stage_one_paths(sfc, timeslot, prob_inst, paths);
+  if (paths.empty()) return izlib::iz_path();
+  return paths.front();
+}
+
+void stage_two(const int co_id, const sfc_request& sfc,
+    const izlib::iz_path& path, const int timeslot,
+    std::vector<std::vector<double>>& cost_matrix,
+    std::vector<std::vector<int>>& node_matrix,
+    problem_instance& prob_inst) {
+  auto& cos = prob_inst.topology.cos;
+  cos[co_id].compute_embedding_cost(sfc.cpu_reqs, sfc.bandwidth,
+      timeslot, cost_matrix, node_matrix);
+}
+
+
+// find a first fit solution based on the cost matrix
+bool first_fit(const sfc_request& sfc, const izlib::iz_path& path,
+    const std::vector<std::vector<std::vector<double>>>& cost_matrices,
+    std::vector<std::vector<int>>& embedding_table) {
+  int next_vnf{0}, curr_co_idx{0};
+  while (next_vnf < sfc.vnf_count && curr_co_idx < path.size()) {
+    for (int i = sfc.vnf_count-1; i >= 0; --i) {
+      if (cost_matrices[curr_co_idx][next_vnf][i] != -1) {
+        for (int j = next_vnf; j <= i; ++j) {
+          embedding_table[curr_co_idx][j] = 1;
+        }
+        next_vnf = i+1;
+        break;
+      }
     }
+    if (next_vnf == sfc.vnf_count) return true;
+    ++curr_co_idx;
   }
-  // if we have found a path and it satisfies the latency constraint,
-  // then the max_path_index will be set to some other value than -1
-  // we check this and reset the unique_ptr to the selcted path
-  // if the max_path_index is still -1, then this function will return
-  // an empty path
-  if (max_path_index != -1) {
-    ret_path.reset(new izlib::iz_path(paths[max_path_index]));
+  return false;
+}
+
+
+// random fit solution for tabu search seed
+bool random_fit(const sfc_request& sfc, const izlib::iz_path& path,
+    std::vector<std::vector<int>>& embedding_table) {
+  std::default_random_engine rnd_engine;
+  std::uniform_int_distribution<> uni_dist(0, path.size()-1);
+  for (int v = 0; v < sfc.vnf_count; ++v) {
+    embedding_table.at(uni_dist(rnd_engine)).at(v) = 1;
   }
-  return std::move(ret_path);
+  return true;
 }
 
-// Stage - 2: Compute cost matrix containing cost of partially embedding a chain
-// in a CO. Do that for all COs on the computed path.
-std::unique_ptr<std::vector<std::vector<std::vector<double>>>>
-ComputeCostMatrix(problem_instance& p_instance, const sfc_request& chain,
-                  izlib::iz_path& path, int ts) {
-  // cost_matrices is a 3D vector. Each entry of the first dimension represents
-  // a cost_matrix corresponding to the CO on the path selected by Stage-1
-  std::unique_ptr<std::vector<std::vector<std::vector<double>>>> cost_matrices(
-      new std::vector<std::vector<std::vector<double>>>(path.size()));
-  auto& cos = p_instance.topology.cos;
-  for (int i = 0; i < path.size(); ++i) {
-    auto co = path.nodes[i];
-    // the co class provides a function to compute the cost_matrix
-    std::vector<std::vector<double>> temp_matrix;
-    cos[co].compute_embedding_cost(chain.cpu_reqs, chain.bandwidth, ts,
-                                   temp_matrix);
-    // individual cost_matrix is calculated and stored in the cost_matrices ds
-    cost_matrices->at(i) = temp_matrix;
-  }
-  return std::move(cost_matrices);
+// compute the embedding cost of an embedding table
+double embedding_cost(problem_instance& prob_inst,
+    const sfc_request& sfc, const izlib::iz_path& path,
+    const std::vector<std::vector<std::vector<double>>>& cost_matrices,
+    const std::vector<std::vector<int>>& embedding_table) {
+  //auto& inter_co_topo = prob_inst.topology.inter_co_topo;
+  double cost{0.0};
+  for (int c = 0; c < path.size(); ++c) {
+    // find starting 1 in embedding table
+    int sfc_start{0}, sfc_end{sfc.vnf_count-1};
+    while(sfc_start < sfc.vnf_count &&
+        embedding_table[c][sfc_start] == 0)
+      ++sfc_start;
+    while(sfc_end >= 0 &&
+        embedding_table[c][sfc_end] == 0)
+      --sfc_end;
+    if (sfc_start <= sfc_end) {
+      cost += cost_matrices[c][sfc_start][sfc_end];
+      // add the cost of backbone links
+//      if (c > 0) {
+//        int co_u = path.nodes[c-1];
+//        int co_v = path.nodes[c];
+//        iz_path inter_co_path;
+//        inter_co_topo.shortest_path(co_u, co_v, inter_co_path, sfc.bandwidth);
+//        if (sfc.bandwidth <= 1000) {
+//          cost += (inter_co_path.size() * 0.0012 * 1.12);
+//        }
+//        else {
+//          cost += (inter_co_path.size() * 0.0043 * 1.12);
+//        }
+//      }
+    }
+  }
+  return cost;
 }
 
-// this function generates a first-fit embedding, which is used to
-// initialize simulated annealing. The path selected by the stage-1 function
-// is passed to this function and this function returns a vector of indexes
-// into the path. If the chain has 3 vnfs then the returned vector will have
-// 3 entries within the range [0-2], e.g., [0, 0, 1] indicates that the first
-// two vnfs are embedded on the first node on the path and the last vnf is
-// embedded on the second node on the path.
-std::unique_ptr<std::vector<int>> GenerateFirstFitSolution(
-    problem_instance& p_instance, sfc_request& chain, izlib::iz_path& path,
-    std::vector<std::vector<std::vector<double>>>& cost_matrices) {
-  int to_embed_start_idx = 0;
-  // vnf_assignment stores the index of a path node
-  // where a vnf is embedded
-  std::unique_ptr<std::vector<int>> vnf_assignment(
-      new std::vector<int>(chain.vnf_count, -1));
-  // loop over the nodes on the path
-  for (int i = 0; i < path.size(); ++i) {
-    // if all the vnfs are embedded break out of the loop
-    if (to_embed_start_idx == chain.vnf_count) break;
-
-    auto& cost_matrix = cost_matrices[i];
-
-    // find out the longest partial chain that can be embedded in the
-    // current node
-    int to_embed_end_idx = -1;
-    for (int k = to_embed_start_idx; k < chain.vnf_count; ++k) {
-      if (cost_matrix[to_embed_start_idx][k] == -1.0) break;
-      to_embed_end_idx = k;
+// returns the nodes selected in an embedding table
+std::vector<int> embedding_nodes(const sfc_request& sfc,
+    const izlib::iz_path& path,
+    const std::vector<std::vector<std::vector<int>>>& node_matrices,
+    const std::vector<std::vector<int>>& embedding_table,
+    std::vector<int>& emb_cos, std::vector<int>& emb_co_nodes) {
+  std::vector<int> nodes;
+  for (int c = 0; c < path.size(); ++c) {
+    // find starting 1 in embedding table
+    int sfc_start{0}, sfc_end{sfc.vnf_count-1};
+    while(sfc_start < sfc.vnf_count &&
+        embedding_table[c][sfc_start] == 0)
+      ++sfc_start;
+    while(sfc_end >= 0 &&
+        embedding_table[c][sfc_end] == 0)
+      --sfc_end;
+    for (int i = sfc_start; i <= sfc_end; ++i) {
+      nodes.push_back(path.nodes[c] * 9 +
+          node_matrices[c][sfc_start][i]);
+      emb_cos.push_back(path.nodes[c]);
+      emb_co_nodes.push_back(node_matrices[c][sfc_start][i]);
     }
+  }
+  return nodes;
+}
 
-    // if any part of the chain is embeddable, then update the index
-    // values in the vector vnf_assignment
-    if (to_embed_end_idx != -1) {
-      for (int k = to_embed_start_idx; k <= to_embed_end_idx; ++k) {
-        vnf_assignment->at(k) = i;
+// checks whether an embedding table is valid
+bool is_valid_embedding(const sfc_request& sfc,const izlib::iz_path& path,
+    const std::vector<std::vector<std::vector<double>>>& cost_matrices,
+    const std::vector<std::vector<int>>& embedding_table) {
+  // vnf_co stores the co_ids for the vnfs in the sfc
+  // according to the provided embedding table
+  std::vector<int> vnf_co(sfc.vnf_count);
+  // loop for each vnf
+  for (int vnf_idx = 0; vnf_idx < sfc.vnf_count; ++vnf_idx) {
+    int sum{0}, non_zero_count{0};
+    // chech each co for vnf vnf_inx
+    for (int co_idx = 0; co_idx < path.size(); ++co_idx) {
+      sum += embedding_table[co_idx][vnf_idx];
+      if (embedding_table[co_idx][vnf_idx]) {
+        ++non_zero_count;
+        // here the entries in the vnf_co are updated to store
+        // the co_ids on the path
+        //vnf_co[vnf_idx] = path.nodes[co_idx];
+        vnf_co[vnf_idx] = co_idx;
       }
+    }
+    // both sum and non_zero_count must be equal to one
+    if (sum != 1 || non_zero_count != 1) return false;
+  }
 
-      // update the start index for the next partial chain
-      to_embed_start_idx = to_embed_end_idx + 1;
+  // check to ensure vnf embedding always moves in the
+  // forward direction
+  for (int v = 1; v < sfc.vnf_count; ++v) {
+    if (vnf_co[v-1] > vnf_co[v]) {
+      return false;
     }
   }
-  return std::move(vnf_assignment);
+
+  // check to see if the 1's in the embedding table
+  // are really valid costs in the cost_matrices
+  for (int c = 0; c < path.size(); ++c) {
+    // find starting 1 in embedding table
+    int sfc_start{0}, sfc_end{sfc.vnf_count-1};
+    while(sfc_start < sfc.vnf_count &&
+        embedding_table[c][sfc_start] == 0)
+      ++sfc_start;
+    // find ending 1 in the embedding table
+    while(sfc_end >= 0 &&
+        embedding_table[c][sfc_end] == 0)
+      --sfc_end;
+    if (sfc_start <= sfc_end) {
+      if (cost_matrices[c][sfc_start][sfc_end] == -1)
+        return false;
+    }
+  }
+
+
+  return true;
+}
+
+void print_emb_table(const std::vector<std::vector<int>>& table,
+    const std::string& message = "") {
+  if (message != "") std::cout << message << std::endl;
+  for (auto& r : table) {
+    for (auto& c : r) std::cout << c << " ";
+    std::cout << std::endl;
+  }
+}
+
+std::vector<int> magic_sequence(const int vnf_count) {
+  std::vector<int> seq;
+  std::default_random_engine rnd_engine;
+  std::uniform_int_distribution<> uni_dist(0, vnf_count-1);
+  int m = 1;
+  for (int i = vnf_count - 1; i >= 0; --i) {
+    seq.push_back(i);
+    for (int j = 0, n; j < m*vnf_count; ++j) {
+      n = uni_dist(rnd_engine);
+      if (!seq.empty() && n != seq.back()) seq.push_back(n);
+    }
+  }
+  for (int i = 0; i < vnf_count; ++i) {
+    seq.push_back(i);
+    for (int j = 0, n; j < m*vnf_count; ++j) {
+      n = uni_dist(rnd_engine);
+      if (!seq.empty() && n != seq.back()) seq.push_back(n);
+    }
+  }
+  return seq;
 }
 
 
-// checks the validity of an vnf assignment
-bool IsValidAssignment(
-    const problem_instance& p_instance, const std::vector<int>& vnf_assignment,
+void print_solution(const std::vector<std::vector<int>>& solution) {
+    for (int j = 0; j < solution[0].size(); ++j) {
+        for (int i = 0; i < solution.size(); ++i) {
+            if (solution[i][j]) {
+                std::cerr << "vnf:" << j << "@co:" << i << " ";
+            }
+        }
+    }
+    std::cerr << std::endl;
+}
+
+bool tabu_search(problem_instance& prob_inst,
+    const sfc_request& sfc, const izlib::iz_path& path,
     const std::vector<std::vector<std::vector<double>>>& cost_matrices,
-    const izlib::iz_path& path) {
-  // Each VNF should be assigned to a node on the path.
-  // A -1 indicates that a VNF has not been assigned.
-  for (int i = 0; i < vnf_assignment.size(); ++i)
-    if (vnf_assignment[i] == -1) return false;
-
-  // VNF i should be placed on a path node that precedes the placement
-  // of VNF i + 1 on the path.
-  for (int i = 1; i < vnf_assignment.size(); ++i) {
-    if (vnf_assignment[i] < vnf_assignment[i - 1]) return false;
-  }
-
-  // If a segment of a chain (i ~> j) is placed in a path node k,
-  // then the corresponding entry in cost matrix that was
-  // computed part of Stage-2 should not be -1.
-  int current_co = vnf_assignment[0];
-  int seg_start = 0;
-  int seg_end = 0;
-  for (int i = 1; i < vnf_assignment.size(); ++i) {
-    if (vnf_assignment[i] != current_co) {
-      seg_end = i - 1;
-      if (cost_matrices[current_co][seg_start][seg_end] == -1.0) return false;
-      current_co = vnf_assignment[i];
-      seg_start = seg_end = i;
+    std::vector<std::vector<int>>& best_solution,
+    double& best_solution_cost) {
+
+    // epsilon to check when solution cost is zero
+    constexpr double epsilon = 0.0001;
+
+    // initial solution from first-fit
+    std::vector<std::vector<int>> current_solution(
+        path.size(), std::vector<int>(sfc.vnf_count, 0));
+    auto res = first_fit(sfc, path, cost_matrices,
+        current_solution);
+
+    // if no fist-fit solution, then random fit
+    if (!res) {
+      for(auto& row : current_solution) {
+        for (auto& e : row) e = 0;
+      }
+      res = random_fit(sfc, path, current_solution);
+    }
+    // if no random-fit, then return false
+    if (!res) return false;
+
+    // overall best solution and cost
+    //best_solution_cost = -1.0;
+    // set best solution = current solution
+    best_solution = current_solution;
+    best_solution_cost = embedding_cost(prob_inst, sfc, path, cost_matrices,
+        best_solution);
+
+    // if the cost of best (first/random-fit) solution is zero
+    // then return it. No need to run tabu search
+    if (best_solution_cost <= epsilon &&
+        is_valid_embedding(sfc, path, cost_matrices, best_solution)) {
+        return true;
+    }
+
+//    cerr << "first_fit " << sfc.id << " ";
+//    print_solution(best_solution);
+//    cerr << "cost = " << best_solution_cost << endl;
+
+    //print_emb_table(best_solution, "first fit or random fit");
+    //cout << best_solution_cost << endl;
+
+    // tabu search specific data strutures
+    std::set<std::pair<int, int>> tabu_set;
+    std::vector<std::vector<int>> tabu_timers(path.size(),
+        std::vector<int>(sfc.vnf_count, 0));
+    const int tabu_period = 50;
+    const int max_iterations = 1000;
+    const int max_no_improvement_iterations = 150;
+    int best_cost_update_timestamp = 0;
+
+    // variables for random number
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<> dis(0.0, 1.0);
+    std::default_random_engine rnd_engine;
+    std::uniform_int_distribution<> uni_dist(0, sfc.vnf_count-1);
+    // main loop for tabu search
+    int iter = 0;
+    double best_nbr_cost = std::numeric_limits<double>::max();
+    for (; iter < max_iterations; ++iter) {
+      // datastructure to keep track of best neighbour
+      std::vector<std::vector<int>> best_nbr;
+      std::pair<int, int> potential_tabu_move(-1, -1);
+
+      // generate neighbors to find the best neighbor for this iteration
+      for (int j : magic_sequence(sfc.vnf_count)) {
+      //for (int j = 0; j < sfc.vnf_count; ++j) {
+      //for (int j = sfc.vnf_count - 1; j >=0; --j) {
+      //for (int k = 0; k < 1500; ++k) {
+        //int j = uni_dist(rnd_engine);
+        // initialize the nbr solution with current solution
+        auto nbr(current_solution);
+        // now change one vnf assignment
+        // find the current index of co for vnf j
+        int curr_co_idx{0}, next_co_idx{0};
+        while (curr_co_idx < path.size() &&
+            nbr[curr_co_idx][j] == 0 )
+          ++curr_co_idx;
+
+        float rnd_num = dis(gen);
+        if (rnd_num <= 0.5) {
+          next_co_idx = (curr_co_idx + path.size() - 1) % path.size();
+        }
+        else {
+          next_co_idx = (curr_co_idx + 1) % path.size();
+        }
+
+        // check for tabu move
+        if (tabu_set.find(std::make_pair(next_co_idx, j)) != tabu_set.end())
+          continue;
+
+        // update current and next co assignment to generate the neighbor
+        nbr[curr_co_idx][j] = 0;
+        nbr[next_co_idx][j] = 1;
+
+//        cerr << "nbr solution " << sfc.id << " ";
+//        print_solution(nbr);
+//        cerr << "cost = " << embedding_cost(prob_inst, sfc, path, cost_matrices, nbr)
+//            << endl;
+
+        //print_emb_table(nbr, "intermediate nbr");
+
+        // if nbr_solution is not valid then continue
+        if (!is_valid_embedding(sfc, path, cost_matrices, nbr))
+          continue;
+
+        // find cost of neighbor solution
+        auto nbr_cost = embedding_cost(prob_inst, sfc, path, cost_matrices, nbr);
+
+        // if cost of nbr solution is zero then just return it
+        if (nbr_cost <= epsilon) {
+            best_solution_cost = nbr_cost;
+            best_solution = nbr;
+            return true;
+        }
+
+        // update best neighbor and potential tabu move
+        if (nbr_cost < best_nbr_cost) {
+          //cout << nbr_cost << " " << best_nbr_cost << endl;
+          best_nbr_cost = nbr_cost;
+          best_nbr = nbr;
+
+          //print_emb_table(best_nbr, "best nbr");
+          //cout << best_nbr_cost << endl;
+
+          potential_tabu_move.first = next_co_idx;
+          potential_tabu_move.second = j;
+        }
+      } // end of for loop for generating neigbor solutions
+
+      // now, update best_solution with the best neighbor so far
+      if (best_nbr_cost < best_solution_cost) {
+        best_solution_cost = best_nbr_cost;
+        best_solution = best_nbr;
+
+        //print_emb_table(best_solution, "best iteration nbr");
+        //cout << best_solution_cost << endl;
+
+        tabu_set.insert(potential_tabu_move);
+        tabu_timers[potential_tabu_move.first][potential_tabu_move.second] =
+            tabu_period;
+        best_cost_update_timestamp = iter;
+
+//        cerr << "next solution " << sfc.id << " ";
+//        print_solution(best_solution);
+//        cerr << "cost = " << best_solution_cost << endl;
+
+      }
+
+      // update tabu list
+      for(auto itr = tabu_set.begin(); itr != tabu_set.end();) {
+        if (tabu_timers[itr->first][itr->second] > 0)
+          --tabu_timers[itr->first][itr->second];
+        if (tabu_timers[itr->first][itr->second] == 0)
+          itr = tabu_set.erase(itr);
+        else
+          ++itr;
+      }
+
+      // if best cost is not updated in the last
+      // max_no_improvement_iterations then break
+      if (iter - best_cost_update_timestamp >
+          max_no_improvement_iterations) {
+        //cout << "break for no improvement" << endl;
+        break;
+      }
+
+    } // end of tabu search iterations
+    return is_valid_embedding(sfc, path, cost_matrices, best_solution);
+}
+
+// build the entire inter + intra co topology 
+// this topology is used to generate the final
+// optimizer output from the embedding table
+// produced by tabu search
+
+void generate_full_topology(problem_instance& prob_inst,
+    izlib::iz_topology& topo,
+    std::vector<char>& node_info, std::vector<int>& server_ids) {
+  //---------------
+  auto& inter_co_topo = prob_inst.topology.inter_co_topo;
+  auto& cos = prob_inst.topology.cos;
+
+  int total_node_count{0}, total_edge_count{0};
+  int max_inodes{0};
+  //total_node_count += cos.size();
+  total_edge_count += inter_co_topo.edge_count;
+  for (auto& co : cos) {
+    total_node_count += co.intra_topo.node_count;
+    total_edge_count += 2*co.intra_topo.edge_count;
+    max_inodes = std::max(max_inodes, co.intra_topo.node_count);
+  }
+  // resize the node_info vector
+  node_info.resize(total_node_count);
+  // ds to hold id mappings
+  std::vector<std::vector<int>> id_map(cos.size(),
+      std::vector<int>(max_inodes));
+  int node_id{0}; // node_id for the merged graph
+  for (auto& co : cos) {
+    // output the switches 
+    for (int i = 0; i < co.server_ids[0]; ++i) {
+      id_map[co.id][i] = node_id;
+      node_info[node_id] = 's';
+      ++node_id;
+    }
+    // now the servers
+    for (auto i : co.server_ids) {
+      id_map[co.id][i] = node_id;
+      node_info[node_id] = 'c';
+      server_ids.push_back(node_id);
+      auto server_ptr = std::dynamic_pointer_cast<esso_server>(
+          co.intra_nodes[i]);
+      ++node_id;
     }
   }
-  // check for the final leg of partial chain
-  seg_end = vnf_assignment.size() - 1;
-  if (cost_matrices[current_co][seg_start][seg_end] == -1.0) return false;
+  // initialize topo
+  topo.init(total_node_count);
+  int edge_id{0};
+  // output inter co edges
+  for (auto& e : inter_co_topo.edges()) {
+    topo.add_edge(id_map[e.u][0], id_map[e.v][0], e.latency, e.residual);
+    topo.add_edge(id_map[e.v][0], id_map[e.u][0], e.latency, e.residual);
+  }
+  // output intra co edges
+  for (auto& co : cos) {
+    // output edges
+    for (auto& e : co.intra_topo.edges()) {
+      topo.add_edge(id_map[co.id][e.u], id_map[co.id][e.v],
+          e.latency, e.residual);
+      topo.add_edge(id_map[co.id][e.v], id_map[co.id][e.u],
+          e.latency, e.residual);
+    }
+  }
+  //---------------
+}
 
-  return true;
+// prints the 404... message when no embedding is found
+void print_404_message(const sfc_request& sfc) {
+  std::cout << "404 " << sfc << std::endl;
 }
 
-double GetAssignmentCost(
-    const std::vector<int>& vnf_assignment,
-    const std::vector<std::vector<std::vector<double>>>& cost_matrices) {
-  double ret = 0.0;
-  int current_co = vnf_assignment[0];
-  int seg_start = 0;
-  int seg_end = 0;
-  for (int i = 1; i < vnf_assignment.size(); ++i) {
-    if (vnf_assignment[i] != current_co) {
-      seg_end = i - 1;
-      ret += cost_matrices[current_co][seg_start][seg_end];
-      current_co = vnf_assignment[i];
-      seg_start = seg_end = i;
+
+bool read_res_topology_file(const std::string& res_topology_filename,
+    problem_instance& prob_inst) {
+  std::fstream fin(res_topology_filename);
+  if (!fin) return false;
+  int co_count, co_id;
+  fin >> co_count;
+  auto& cos = prob_inst.topology.cos;
+  for (int i = 0; i < co_count; ++i) {
+    fin >> co_id;
+    fin >> cos[co_id].carbon;
+    for (int j = 0; j < 24; ++j) {
+      fin >> cos[co_id].green_residual[j];
     }
   }
-  ret += cost_matrices[current_co][seg_start][seg_end];
-  return ret;
+  int node_count, edge_count;
+  fin >> node_count >> edge_count;
+  int node_id, cpu_count;
+  char type;
+  double sleep_power, base_power, per_cpu_power;
+  for (int i = 0; i < node_count; ++i) {
+    fin >> node_id >> type >> co_id;
+    if (type == 'c') {
+      fin >> sleep_power >> base_power >> cpu_count >> per_cpu_power;
+      cos[co_id].set_residual_cpu(node_id%9, cpu_count);
+    }
+    else {
+      // for switch just read data, no need to update any state
+      fin >> sleep_power >> base_power;
+    }
+  }
+  int edge_id, node_u, node_v, capacity, latency;
+  for (int i = 0; i < edge_count; ++i) {
+    fin >> edge_id >> node_u >> node_v >> type >> co_id >>
+        capacity >> latency;
+    if (type == 'b') {
+      prob_inst.topology.set_residual_bandwidth(node_u/9, node_v/9, capacity);
+    }
+    else {
+      cos[co_id].set_residual_bandwidth(node_u%9, node_v%9, capacity);
+    }
+  }
+  fin >> type;
+  fin.close();
+  return true;
+}
+
+// resources committed for an embedded sfc. A long running process keeps
+// one of these per live sfc so that the exact same resources can be
+// released when the sfc expires or migrates.
+struct sfc_mapping {
+  int sfc_id{-1};
+  int timeslot{0}; // timeslot in which the sfc arrived
+  int ttl{0};
+  int bandwidth{0};
+  // increase of the carbon footprint, brown and green energy caused by
+  // the embedding
+  double cost{0.0}, brown_energy{0.0}, green_energy{0.0};
+  // co and intra-co server for each vnf
+  std::vector<int> emb_cos, emb_co_nodes, cpu_reqs;
+  izlib::iz_path_list backbone_paths;
+  std::vector<std::pair<int, izlib::iz_path>> intra_paths; // (co_id, path)
+};
+
+// the first-fit solution is used as is, without running tabu search
+// (this is what esso_firstfit.cpp does)
+bool first_fit_search(problem_instance& prob_inst,
+    const sfc_request& sfc, const izlib::iz_path& path,
+    const std::vector<std::vector<std::vector<double>>>& cost_matrices,
+    std::vector<std::vector<int>>& best_solution,
+    double& best_solution_cost) {
+  best_solution = std::vector<std::vector<int>>(
+      path.size(), std::vector<int>(sfc.vnf_count, 0));
+  if (!first_fit(sfc, path, cost_matrices, best_solution)) return false;
+  best_solution_cost = embedding_cost(prob_inst, sfc, path, cost_matrices,
+      best_solution);
+  return true;
 }
 
-// Stage - 3: Perform tabu search on VNF -> CO assignment matrix.
+// Stage-2 and Stage-3 over the candidate paths between the ingress and
+// egress co, pulled one by one from next_path until it returns false.
+// co_costs(co_id, cost_matrix, node_matrix) provides the Stage-2 tables
+// of a co. On success emb_cos/emb_co_nodes hold the co and intra-co
+// server of every vnf and emb_nodes holds the merged topology node ids.
+// If use_tabu is false Stage-3 stops at the first-fit solution.
 //
-/*std::unique_ptr<std::vector<int>> TabuSearch(
-    problem_instance& p_instance, sfc_request& chain, izlib::iz_path& path,
-    std::vector<std::vector<std::vector<double>>>& cost_matrices,
-    double& best_cost) {
-  // Generate an initial solution by using first fit algorithm.
-  auto initial_vnf_assignment =
-      GenerateFirstFitSolution(p_instance, chain, path, cost_matrices);
-
-  // First check if the initial solution is valid or not. If it is invalid then
-  // declare embedding failed and return.
-  if (!IsValidAssignment(p_instance, *initial_vnf_assignment.get(),
-                         cost_matrices, path))
-    return nullptr;
-
-  // Initialize data structure to contain best solution. Also initialize best
-  // solution cost.
-  std::vector<int> current_vnf_assignment(*initial_vnf_assignment.get());
-  std::unique_ptr<std::vector<int>> best_assignment(
-      new std::vector<int>(current_vnf_assignment));
-  best_cost = GetAssignmentCost(current_vnf_assignment, cost_matrices);
-
-  std::set<std::pair<int, int>> tabu_set;
-  std::vector<std::vector<int>> tabu_timer(
-      path.size(), std::vector<int>(chain.vnf_count, 0));
-  const int kTabuPeriod = 500;
-  const int kMaxIterations = 100000;
-  const int kMaxNonImprovedIterations = 1500;
-
-  int best_cost_update_timestamp = 0;
-  int iter = 0;
-  for (; iter < kMaxIterations; ++iter) {
-    double best_neighbor_cost = ~(1 << 31);
-    std::unique_ptr<std::vector<int>> best_neighbor(nullptr);
-    std::pair<int, int> potential_tabu_move(-1, -1);
-    // Generate the neighbors of current solution. A neighbor is a valid
-    // solution which differs with the current solution by one VNF placement.
-    for (int j = 0; j < chain.vnf_count; ++j) {
-      // Create a neighboring solution by changing the placement of one VNF.
-      std::unique_ptr<vector<int>> neighbor(
-          new std::vector<int>(current_vnf_assignment));
-      neighbor->at(j) = (current_vnf_assignment[j] + 1) % path.size();
-
-      // Now check the tabu set if the current move, i.e., vnf j to
-      // neighbor->at(j) is in the tabu set or not. If yes, then do not make the
-      // move.
-      if (tabu_set.find(std::pair<int, int>(j, neighbor->at(j))) !=
-          tabu_set.end())
-        continue;
-
-      // Check if making the move creates a valid solution or not.
-      if (!IsValidAssignment(p_instance, *neighbor.get(), cost_matrices, path))
-        continue;
-
-      // Now updated best neighbor based on the cost and also create a potential
-      // tabu move.
-      double neighbor_cost = GetAssignmentCost(*neighbor.get(), cost_matrices);
-      if (neighbor_cost < best_neighbor_cost) {
-        best_neighbor_cost = neighbor_cost;
-        best_neighbor = std::move(neighbor);
-        potential_tabu_move.first = j;
-        potential_tabu_move.second = best_neighbor->at(j);
+// The paths are evaluated in rounds of one path per thread. Stage-2 does
+// not depend on the path, so it runs once for every new co of a round.
+// The cos are evaluated in parallel, co_costs is therefore called
+// concurrently for different cos and must only touch the state of the
+// co it is given. Stage-3 runs for the paths of a round in parallel; the
+// cheapest path wins and ties go to the earlier path, as in a serial
+// scan. Costs are never negative, so no more paths are pulled once a
+// round found a zero-cost embedding.
+template <typename co_cost_fn>
+bool search_embedding(problem_instance& prob_inst, const sfc_request& sfc,
+    std::function<bool(izlib::iz_path&)> next_path, co_cost_fn co_costs,
+    std::vector<int>& emb_nodes, std::vector<int>& emb_cos,
+    std::vector<int>& emb_co_nodes, double& time,
+    const bool use_tabu = true) {
+
+  // this time calculates the running time of the heuristic
+  iz_timer htimer;
+  time = 0.0;
+
+  auto& pool = izlib::iz_thread_pool::shared();
+
+  // Stage-2 tables of the cos seen so far
+  std::unordered_map<int, int> co_index;
+  std::vector<std::vector<std::vector<double>>> co_cost_matrices;
+  std::vector<std::vector<std::vector<int>>> co_node_matrices;
+
+  izlib::iz_path_list paths;
+  std::vector<char> path_res;
+  std::vector<double> path_cost;
+  std::vector<std::vector<std::vector<int>>> path_solution;
+  int best_path{-1};
+  double best_cost{std::numeric_limits<double>::max()};
+
+  bool has_more = true;
+  while (has_more && !(best_path != -1 && best_cost <= 0.0)) {
+    // pull the paths of this round
+    size_t first = paths.size();
+    std::vector<int> new_cos;
+    izlib::iz_path path;
+    while (paths.size() - first < static_cast<size_t>(pool.thread_count())) {
+      if (!next_path(path)) {
+        has_more = false;
+        break;
       }
+      if (path.latency > sfc.latency) continue;
+      for (int co_id : path.nodes) {
+        if (co_index.emplace(co_id, co_index.size()).second) {
+          new_cos.push_back(co_id);
+        }
+      }
+      paths.push_back(std::move(path));
     }
+    if (paths.size() == first) break;
 
-    if (best_neighbor.get() != nullptr) {
-      if (best_neighbor_cost < best_cost) {
-        best_assignment = std::move(best_neighbor);
-        best_cost = best_neighbor_cost;
-        tabu_set.insert(potential_tabu_move);
-        tabu_timer[potential_tabu_move.first][potential_tabu_move.second] =
-            kTabuPeriod;
-        best_cost_update_timestamp = iter;
+    // Stage-2: compute the cost matrix for the new co's
+    co_cost_matrices.resize(co_index.size());
+    co_node_matrices.resize(co_index.size());
+    pool.parallel_for(new_cos.size(), [&](int i) {
+      int c = co_index.at(new_cos[i]);
+      co_costs(new_cos[i], co_cost_matrices[c], co_node_matrices[c]);
+    });
+
+    // Stage-3: call tabu search on every path of the round
+    path_res.resize(paths.size(), false);
+    path_cost.resize(paths.size());
+    path_solution.resize(paths.size());
+    pool.parallel_for(paths.size() - first, [&](int r) {
+      int p = first + r;
+      auto& path = paths[p];
+      std::vector<std::vector<std::vector<double>>> cost_matrices(path.size());
+      for (size_t i = 0; i < path.size(); ++i) {
+        cost_matrices[i] = co_cost_matrices[co_index.at(path.nodes[i])];
+      }
+      auto& solution = path_solution[p];
+      solution = std::vector<std::vector<int>>(
+          path.size(), std::vector<int>(sfc.vnf_count, 0));
+      path_res[p] = use_tabu ?
+          tabu_search(prob_inst, sfc, path, cost_matrices, solution,
+              path_cost[p]) :
+          first_fit_search(prob_inst, sfc, path, cost_matrices, solution,
+              path_cost[p]);
+    });
+
+    for (size_t p = first; p < paths.size(); ++p) {
+      if (path_res[p] && best_cost > path_cost[p]) {
+        best_cost = path_cost[p];
+        best_path = p;
       }
     }
+  }
+  time = htimer.time();
+
+  if (best_path == -1) {
+    std::cerr << "failed to find any solution" << std::endl;
+    return false;
+  }
+
+  auto& embedding_path = paths[best_path];
+  std::vector<std::vector<std::vector<int>>> best_node_matrices(
+      embedding_path.size());
+  for (size_t i = 0; i < embedding_path.size(); ++i) {
+    best_node_matrices[i] =
+        co_node_matrices[co_index.at(embedding_path.nodes[i])];
+  }
+  emb_cos.clear();
+  emb_co_nodes.clear();
+  emb_nodes = embedding_nodes(sfc, embedding_path,
+      best_node_matrices, path_solution[best_path], emb_cos, emb_co_nodes);
+  return true;
+}
+
+// search_embedding over a fixed list of candidate paths
+template <typename co_cost_fn>
+bool search_embedding(problem_instance& prob_inst, const sfc_request& sfc,
+    const izlib::iz_path_list& paths, co_cost_fn co_costs,
+    std::vector<int>& emb_nodes, std::vector<int>& emb_cos,
+    std::vector<int>& emb_co_nodes, double& time,
+    const bool use_tabu = true) {
+  size_t next_index{0};
+  auto next_path = [&](izlib::iz_path& path) {
+    if (next_index == paths.size()) return false;
+    path = paths[next_index++];
+    return true;
+  };
+  return search_embedding(prob_inst, sfc, next_path, co_costs, emb_nodes,
+      emb_cos, emb_co_nodes, time, use_tabu);
+}
+
+// where the candidate paths of an sfc come from
+enum class path_source {
+  shortest,     // the k shortest paths, by yen's algorithm
+  green_front   // the first k paths of stage_one_paths, greenest first
+};
+
+// search_embedding over up to k candidate paths from source, with
+// Stage-2 computed from the current state of the cos. The shortest paths
+// are generated on demand and only within the latency bound of the sfc,
+// so the search ends once no path meets the bound or after a zero-cost
+// embedding. With ksp_cache the paths of earlier searches between the
+// same cos are reused.
+bool search_embedding(problem_instance& prob_inst, const sfc_request& sfc,
+    const int timeslot, const int k, std::vector<int>& emb_nodes,
+    std::vector<int>& emb_cos, std::vector<int>& emb_co_nodes, double& time,
+    const bool use_tabu = true, izlib::iz_ksp_cache* ksp_cache = nullptr,
+    const path_source source = path_source::shortest) {
+  time = 0.0;
+  // no path meets the latency bound, whatever the residuals are
+  if (prob_inst.topology.backbone_latency(sfc.ingress_co, sfc.egress_co) >
+      sfc.latency) {
+    std::cerr << "no embedding path" << std::endl;
+    return false;
+  }
+  auto& inter_co_topo = prob_inst.topology.inter_co_topo;
+  auto co_costs = [&](int co_id, std::vector<std::vector<double>>& cost_matrix,
+      std::vector<std::vector<int>>& node_matrix) {
+    prob_inst.topology.cos[co_id].compute_embedding_cost(sfc.cpu_reqs,
+        sfc.bandwidth, timeslot, cost_matrix, node_matrix);
+  };
+  if (source == path_source::green_front) {
+    izlib::iz_path_list paths;
+    stage_one_paths(sfc, timeslot, prob_inst, paths);
+    if (paths.size() > static_cast<size_t>(k)) paths.resize(k);
+    if (paths.empty()) {
+      std::cerr << "no embedding path" << std::endl;
+      return false;
+    }
+    for (auto& path : paths) inter_co_topo.update_path_metrics(path);
+    return search_embedding(prob_inst, sfc, paths, co_costs, emb_nodes,
+        emb_cos, emb_co_nodes, time, use_tabu);
+  }
+  izlib::iz_ksp_generator local_ksp(inter_co_topo, sfc.ingress_co,
+      sfc.egress_co, sfc.bandwidth, sfc.latency);
+  auto& ksp = ksp_cache ?
+      ksp_cache->paths(sfc.ingress_co, sfc.egress_co, sfc.bandwidth) :
+      local_ksp;
+  // cached paths are not bounded, they are in order of latency though
+  int path_count{0};
+  auto next_path = [&](izlib::iz_path& path) {
+    if (path_count == k || !ksp.path_at(path_count, path) ||
+        path.latency > sfc.latency) {
+      return false;
+    }
+    ++path_count;
+    inter_co_topo.update_path_metrics(path);
+    return true;
+  };
+  izlib::iz_path first_path;
+  if (!ksp.path_at(0, first_path) || first_path.latency > sfc.latency) {
+    std::cerr << "no embedding path" << std::endl;
+    return false;
+  }
+  return search_embedding(prob_inst, sfc,
+      std::function<bool(izlib::iz_path&)>(next_path), co_costs, emb_nodes,
+      emb_cos, emb_co_nodes, time, use_tabu);
+}
+
+// allocates bandwidth on the shortest backbone path between two cos
+bool allocate_backbone_path(problem_instance& prob_inst, const int co_u,
+    const int co_v, const int bandwidth, sfc_mapping& mapping,
+    izlib::iz_spt_cache& spt_cache) {
+  izlib::iz_path path;
+  spt_cache.shortest_path(co_u, co_v, bandwidth, path);
+  if (!path.is_valid()) return false;
+  prob_inst.topology.allocate_bandwidth(path, bandwidth);
+  mapping.backbone_paths.push_back(path);
+  return true;
+}
+
+// allocates bandwidth on the shortest path between two nodes of a co
+bool allocate_intra_path(problem_instance& prob_inst, const int co_id,
+    const int u, const int v, const int bandwidth, sfc_mapping& mapping) {
+  auto& co = prob_inst.topology.cos[co_id];
+  izlib::iz_path path;
+  co.shortest_path(u, v, path, bandwidth);
+  if (!path.is_valid()) return false;
+  co.allocate_bandwidth(path, bandwidth);
+  mapping.intra_paths.emplace_back(co_id, path);
+  return true;
+}
 
-    // Update tabu list.
-    for (auto tabu_it = tabu_set.begin(); tabu_it != tabu_set.end();
-         ++tabu_it) {
-      if (tabu_timer[tabu_it->first][tabu_it->second] > 0) {
-        tabu_timer[tabu_it->first][tabu_it->second]--;
-        if (!tabu_timer[tabu_it->first][tabu_it->second]) {
-          tabu_set.erase(tabu_it);
+// releases everything recorded in the mapping, cpu first so that the
+// servers are idle by the time their links are released
+void release_embedding(problem_instance& prob_inst,
+    const sfc_mapping& mapping) {
+  auto& cos = prob_inst.topology.cos;
+  for (size_t i = 0; i < mapping.cpu_reqs.size(); ++i) {
+    cos[mapping.emb_cos[i]].release_cpu(mapping.emb_co_nodes[i],
+        mapping.cpu_reqs[i]);
+  }
+  for (auto& co_path : mapping.intra_paths) {
+    cos[co_path.first].release_bandwidth(co_path.second, mapping.bandwidth);
+  }
+  for (auto& path : mapping.backbone_paths) {
+    prob_inst.topology.release_bandwidth(path, mapping.bandwidth);
+  }
+}
+
+// allocates the intra-co paths that visit the servers in same_co_nodes
+// in order, starting from and returning to the border router
+bool allocate_co_segment(problem_instance& prob_inst, const int co_id,
+    const std::vector<int>& same_co_nodes, const int bandwidth,
+    sfc_mapping& mapping) {
+  int u = 0;
+  for (int v : same_co_nodes) {
+    if (u == v) continue;
+    if (!allocate_intra_path(prob_inst, co_id, u, v, bandwidth, mapping)) {
+      std::cerr << "failed to find path within co" << std::endl;
+      return false;
+    }
+    u = v;
+  }
+  if (!allocate_intra_path(prob_inst, co_id, u, 0, bandwidth, mapping)) {
+    std::cerr << "failed to find last path within co" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// allocates backbone bandwidth, intra-co bandwidth and cpu for the
+// embedding found by search_embedding. Every allocation is recorded in
+// mapping; on failure the partial allocation is rolled back.
+// the backbone legs are read from the shortest path trees of spt_cache,
+// a local cache still shares the tree of a co that starts several legs
+bool commit_embedding(problem_instance& prob_inst, const sfc_request& sfc,
+    const std::vector<int>& emb_cos, const std::vector<int>& emb_co_nodes,
+    sfc_mapping& mapping, izlib::iz_spt_cache* spt_cache = nullptr) {
+  izlib::iz_spt_cache local_cache(prob_inst.topology.inter_co_topo);
+  auto& trees = spt_cache ? *spt_cache : local_cache;
+  mapping.sfc_id = sfc.id;
+  mapping.ttl = sfc.ttl;
+  mapping.bandwidth = sfc.bandwidth;
+  mapping.emb_cos.clear();
+  mapping.emb_co_nodes.clear();
+  mapping.cpu_reqs.clear();
+  mapping.backbone_paths.clear();
+  mapping.intra_paths.clear();
+
+  bool committed = true;
+  // if the first co is not the ingress, then find a path
+  // from the ingress to the first co and allocate bandwidth
+  // in esso_topology class
+  if (sfc.ingress_co != emb_cos.front() &&
+      !allocate_backbone_path(prob_inst, sfc.ingress_co, emb_cos.front(),
+          sfc.bandwidth, mapping, trees)) {
+    std::cerr << "failed to find path from ingress co to co[0]" << std::endl;
+    committed = false;
+  }
+  // allocate bandwidth for the next backbone links
+  for (size_t i = 1; committed && i < emb_cos.size(); ++i) {
+    if (emb_cos[i-1] != emb_cos[i] &&
+        !allocate_backbone_path(prob_inst, emb_cos[i-1], emb_cos[i],
+            sfc.bandwidth, mapping, trees)) {
+      std::cerr << "failed to find path for backbone links" << std::endl;
+      committed = false;
+    }
+  }
+  // now for the last backbone link
+  if (committed && sfc.egress_co != emb_cos.back() &&
+      !allocate_backbone_path(prob_inst, emb_cos.back(), sfc.egress_co,
+          sfc.bandwidth, mapping, trees)) {
+    std::cerr << "failed to find path from last co to egress co" << std::endl;
+    committed = false;
+  }
+  // now process the intra-co links and servers (and switches)
+  if (committed) {
+    std::vector<int> same_co_nodes;
+    int last_co = emb_cos.front();
+    same_co_nodes.push_back(emb_co_nodes.front());
+    for (size_t i = 1; committed && i < emb_cos.size(); ++i) {
+      if (emb_cos[i] == last_co) {
+        if (same_co_nodes.back() != emb_co_nodes[i]) {
+          same_co_nodes.push_back(emb_co_nodes[i]);
         }
       }
+      else {
+        // now we allocate bandwidth and start a fresh
+        // same_co_nodes
+        committed = allocate_co_segment(prob_inst, last_co, same_co_nodes,
+            sfc.bandwidth, mapping);
+        same_co_nodes.clear();
+        same_co_nodes.push_back(emb_co_nodes[i]);
+      }
+      last_co = emb_cos[i];
+    }
+    if (committed) {
+      committed = allocate_co_segment(prob_inst, last_co, same_co_nodes,
+          sfc.bandwidth, mapping);
     }
+  }
+  if (!committed) {
+    release_embedding(prob_inst, mapping);
+    return false;
+  }
+  // allocate cpu
+  for (size_t i = 0; i < emb_cos.size(); ++i) {
+    prob_inst.topology.cos[emb_cos[i]].allocate_cpu(emb_co_nodes[i],
+        sfc.cpu_reqs[i]);
+  }
+  mapping.emb_cos = emb_cos;
+  mapping.emb_co_nodes = emb_co_nodes;
+  mapping.cpu_reqs = sfc.cpu_reqs;
+  return true;
+}
+
+// applies (or removes) the bandwidth of a mapping on the merged topology
+// built by generate_full_topology, so that it can be kept in sync with
+// prob_inst instead of being regenerated for every sfc
+void mirror_embedding(const problem_instance& prob_inst,
+    izlib::iz_topology& full_topo, const sfc_mapping& mapping, bool allocate) {
+  const auto& cos = prob_inst.topology.cos;
+  auto update = [&](int u, int v) {
+    if (allocate) full_topo.allocate_bandwidth(u, v, mapping.bandwidth);
+    else full_topo.release_bandwidth(u, v, mapping.bandwidth);
+  };
+  for (auto& path : mapping.backbone_paths) {
+    for (size_t i = 1; i < path.size(); ++i) {
+      int co_u = path.nodes[i-1], co_v = path.nodes[i];
+      update(co_u * cos[co_u].inter_co_node_count,
+          co_v * cos[co_v].inter_co_node_count);
+    }
+  }
+  for (auto& co_path : mapping.intra_paths) {
+    int offset = co_path.first * cos[co_path.first].inter_co_node_count;
+    auto& path = co_path.second;
+    for (size_t i = 1; i < path.size(); ++i) {
+      update(offset + path.nodes[i-1], offset + path.nodes[i]);
+    }
+  }
+}
+
+// computes the partial paths between the ingress, the embedded nodes and
+// the egress on full_topo. Consecutive vnfs on the same server get the
+// two node path (u, u). Returns false if any of the paths is not found.
+bool embedding_full_paths(const problem_instance& prob_inst,
+    izlib::iz_topology& full_topo, const sfc_request& sfc,
+    const std::vector<int>& emb_nodes, izlib::iz_path_list& full_paths) {
+  // a vector to hold the ingress + emb_nodes + egress
+  std::vector<int> full_path_nodes;
+  int inter_co_node_count = prob_inst.topology.cos[0].inter_co_node_count;
+  full_path_nodes.push_back(sfc.ingress_co * inter_co_node_count);
+  std::copy(emb_nodes.begin(), emb_nodes.end(),
+      std::back_inserter(full_path_nodes));
+  full_path_nodes.push_back(sfc.egress_co * inter_co_node_count);
+
+  full_paths.clear();
+  int u = full_path_nodes[0];
+  for (size_t v_idx = 1; v_idx < full_path_nodes.size(); ++v_idx) {
+    int v = full_path_nodes[v_idx];
+    izlib::iz_path p;
+    if (u == v) {
+      p.nodes = {u, v};
+    }
+    else {
+      // find the shortest path between u and v, with the landmarks of
+      // full_topo if they were built, otherwise with dijkstra
+      full_topo.shortest_path(u, v, p, sfc.bandwidth,
+          izlib::iz_topology::no_latency_bound,
+          izlib::iz_search_mode::landmarks);
+      if (!p.is_valid()) {
+        std::cerr << "failed to find path full topo" << std::endl;
+        return false;
+      }
+    }
+    full_paths.push_back(p);
+    u = v;
+  }
+  return true;
+}
+
+// writes the "200 ..." output line of an embedding. The partial paths
+// are computed on full_topo by embedding_full_paths. Returns false if any
+// of them cannot be found.
+bool write_embedding(std::ostream& out, const problem_instance& prob_inst,
+    izlib::iz_topology& full_topo, const sfc_request& sfc,
+    const double emb_cost,
+    const std::vector<int>& emb_nodes, const std::vector<int>& emb_cos,
+    const double time, const double brown_energy, const double green_energy) {
+  izlib::iz_path_list full_paths;
+  if (!embedding_full_paths(prob_inst, full_topo, sfc, emb_nodes,
+      full_paths)) {
+    return false;
+  }
+
+  std::ostringstream oss;
+
+  //OUTPUT sfc and cost
+  oss << "200 " << sfc << " ";
+  oss << emb_cost << " ";
+
+  // OUTPUT the number of nodes followed by the nodes
+  oss << sfc.vnf_count << " ";
+  for (auto node : emb_nodes) oss << node << " ";
+
+  // co stretcy
+  oss << std::set<int>(emb_cos.begin(), emb_cos.end()).size() << " ";
+
+  // OUTPUT the number of partial paths on the full path
+  // always equal to sfc.vnf_count + 1
+  oss << full_paths.size() << " ";
+  // OUTPUT the paths, number of nodes, then the nodes
+  for (auto& p : full_paths) {
+    oss << p.size() << " ";
+    for (auto n : p.nodes) oss << n << " ";
+  }
+  oss << time << " " << brown_energy << " " << green_energy << std::endl;
+  out << oss.str();
+  return true;
+}
 
-    // If best cost is not updated in last kMaxNonImprovedIterations then break.
-    if (iter - best_cost_update_timestamp > kMaxNonImprovedIterations) break;
-
-    // If the move is in tabu list then continue;
-
-    // Otherwise apply the move to the current solution and generate a
-    // neighboring solution.
-
-    ++iter;
-  }
-  return std::move(best_assignment);
-}*/
-
-// Heuristic driver funciton. This function calls the individual functions
-// responsible for each of the stages and constructs the solution accordingly.
-/*std::unique_ptr<std::vector<int>> EssoHeuristic(problem_instance& p_instance,
-                                                sfc_request& chain, int ts,
-                                                double& best_cost) {
-  const int kNumShortestPaths = 3;
-  auto embedding_path =
-      GetPathWithMaxGreenEnergy(p_instance, chain, kNumShortestPaths, ts);
-  auto cost_matrices =
-      ComputeCostMatrix(p_instance, chain, *embedding_path.get(), ts);
-  auto vnf_assignment = TabuSearch(p_instance, chain, *embedding_path.get(),
-                                   *cost_matrices.get(), best_cost);
-  return std::move(vnf_assignment);
-}*/
 #endif // ESSO_HEURISTIC_HPP_
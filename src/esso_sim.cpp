@@ -0,0 +1,355 @@
+#include <map>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <iostream>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "esso_batch.hpp"
+#include "esso_heuristic.hpp"
+#include "problem_instance.hpp"
+#include "stop_watch.hpp"
+
+using namespace std;
+using namespace izlib;
+
+// in-process replacement for run_simulation.py. The dataset is loaded once
+// and every timeslot of timeslots.dat is simulated against the in-memory
+// problem_instance: expired sfcs are released, new sfcs are embedded as
+// one batch (see esso_batch.hpp) and the sfcs of earlier timeslots,
+// including the ones that could not be embedded, are checked for
+// migration. The output files have the same format and meaning as the ones
+// written by run_simulation.py.
+
+string join_path(const string& dir, const string& file) {
+  if (dir.back() != '/') return dir + "/" + file;
+  return dir + file;
+}
+
+void print_usage() {
+  cerr << "usage: ./esso_sim.o <relative-path-to-dataset-dir> " <<
+      "<relative-path-to-run-dir> [-f] [-g] [-m <migration-threshold>] " <<
+      "[-o <arrival|cpu|latency>]" << endl;
+  cerr << "  -f  use first-fit instead of tabu search" << endl;
+  cerr << "  -g  search the paths of the stage-1 green front instead of " <<
+      "the k shortest paths" << endl;
+  cerr << "  -m  % cost reduction to trigger a migration (default=0.3)" << endl;
+  cerr << "  -o  order of the new sfcs of a timeslot: arrival (default), " <<
+      "largest cpu or tightest latency first" << endl;
+}
+
+// linear interpolation between closest ranks, same as numpy.percentile
+double percentile(vector<double> values, double p) {
+  sort(values.begin(), values.end());
+  double rank = p / 100.0 * (values.size() - 1);
+  size_t lo = floor(rank), hi = ceil(rank);
+  return values[lo] + (rank - lo) * (values[hi] - values[lo]);
+}
+
+struct esso_sim {
+  problem_instance& prob_inst;
+  int k;
+  bool use_tabu;
+  double migration_threshold;
+  batch_order order;
+  path_source source;
+
+  // merged topology used to report the partial paths of an embedding,
+  // kept in sync with prob_inst by mirroring every commit and release
+  iz_topology full_topo;
+  // embedded sfcs, ordered by sfc id
+  map<int, sfc_mapping> mappings;
+  // arrival timeslot of the sfcs whose ttl has not ended, embedded or
+  // not, ordered by sfc id
+  map<int, int> alive_sfcs;
+  // backbone paths shared by all searches of the simulation
+  iz_ksp_cache ksp_cache;
+  // shortest path trees the committed backbone legs are read from
+  iz_spt_cache spt_cache;
+
+  // counters for the acceptance ratio
+  int embed_sfc_count{0};
+  int prced_sfc_count{0};
+  // search time (ms) of every successful embedding
+  vector<double> running_times;
+  // sum of the costs of the live embeddings at the time they were
+  // made, the carbon footprint run_simulation.py reports
+  double carbon_fp{0.0}, brown_energy{0.0}, green_energy{0.0};
+
+  esso_sim(problem_instance& prob_inst, int k, bool use_tabu,
+      double migration_threshold, batch_order order, path_source source) :
+      prob_inst(prob_inst), k(k), use_tabu(use_tabu),
+      migration_threshold(migration_threshold), order(order), source(source),
+      ksp_cache(prob_inst.topology.inter_co_topo),
+      spt_cache(prob_inst.topology.inter_co_topo) {
+    vector<char> node_info;
+    vector<int> server_ids;
+    generate_full_topology(prob_inst, full_topo, node_info, server_ids);
+    // built once for the whole simulation, commits and releases are
+    // mirrored as residual changes which keep them valid
+    full_topo.build_landmarks(8);
+  }
+
+  // green capacities are given for the hours of one day, longer
+  // simulations wrap around to the same daily profile
+  int green_slot(const int timeslot) {
+    return timeslot % prob_inst.topology.cos.front().green_capacity.size();
+  }
+
+  // adds (sign 1) or removes (sign -1) the cost of an embedding from
+  // the running totals
+  void add_to_totals(const sfc_mapping& mapping, double sign) {
+    carbon_fp += sign * mapping.cost;
+    brown_energy += sign * mapping.brown_energy;
+    green_energy += sign * mapping.green_energy;
+  }
+
+  void release(map<int, sfc_mapping>::iterator itr) {
+    add_to_totals(itr->second, -1.0);
+    mirror_embedding(prob_inst, full_topo, itr->second, false);
+    release_embedding(prob_inst, itr->second);
+    mappings.erase(itr);
+  }
+
+  // mirrors a committed mapping on the merged topology and fills the
+  // server count, co count and path stretch of the embedding. Returns
+  // false, with the mapping released, if the merged topology does not
+  // have the partial paths.
+  bool accept(const sfc_request& sfc, const vector<int>& emb_nodes,
+      const sfc_mapping& mapping, int& server_count, int& co_count,
+      int& path_stretch) {
+    mirror_embedding(prob_inst, full_topo, mapping, true);
+    iz_path_list full_paths;
+    if (!embedding_full_paths(prob_inst, full_topo, sfc, emb_nodes,
+        full_paths)) {
+      mirror_embedding(prob_inst, full_topo, mapping, false);
+      release_embedding(prob_inst, mapping);
+      return false;
+    }
+    server_count = set<int>(emb_nodes.begin(), emb_nodes.end()).size();
+    co_count = set<int>(mapping.emb_cos.begin(),
+        mapping.emb_cos.end()).size();
+    path_stretch = 0;
+    for (auto& p : full_paths) path_stretch += p.size();
+    return true;
+  }
+
+  // tries to migrate an sfc that arrived in an earlier timeslot. Returns
+  // true if the new embedding reduces the cost by at least
+  // migration_threshold. An sfc that could not be embedded is retried
+  // without a threshold, as run_simulation.py does.
+  bool migrate(const int timeslot, const sfc_request& sfc) {
+    auto old_itr = mappings.find(sfc.id);
+    bool is_embedded = old_itr != mappings.end();
+    int slot = green_slot(timeslot);
+
+    double brown_before, green_before;
+    double cost_before = prob_inst.topology.get_carbon_fp(slot,
+        brown_before, green_before);
+
+    double time;
+    vector<int> emb_nodes, emb_cos, emb_co_nodes;
+    sfc_mapping mapping;
+    if (!search_embedding(prob_inst, sfc, slot, k, emb_nodes,
+        emb_cos, emb_co_nodes, time, use_tabu, &ksp_cache, source) ||
+        !commit_embedding(prob_inst, sfc, emb_cos, emb_co_nodes, mapping,
+            &spt_cache)) {
+      return false;
+    }
+    double brown_energy, green_energy;
+    mapping.cost = prob_inst.topology.get_carbon_fp(slot,
+        brown_energy, green_energy) - cost_before;
+    mapping.brown_energy = brown_energy - brown_before;
+    mapping.green_energy = green_energy - green_before;
+
+    if (is_embedded && old_itr->second.cost > 0 &&
+        mapping.cost > (1.0 - migration_threshold) * old_itr->second.cost) {
+      release_embedding(prob_inst, mapping);
+      return false;
+    }
+
+    int server_count, co_count, path_stretch;
+    if (!accept(sfc, emb_nodes, mapping, server_count, co_count,
+        path_stretch)) {
+      return false;
+    }
+    running_times.push_back(time);
+
+    // a migrated sfc keeps its arrival timeslot
+    mapping.timeslot = alive_sfcs[sfc.id];
+    if (is_embedded) release(old_itr);
+    add_to_totals(mapping, 1.0);
+    mappings[sfc.id] = mapping;
+    return true;
+  }
+
+  void run(ostream& timeslot_data, ostream& sfc_data) {
+    timeslot_data << "timeslot,carbon_footprint,brown_energy,green_energy," <<
+        "acceptance_ratio,migration_count," <<
+        "ps_min,ps_5th,ps_mean,ps_95th,ps_max" << endl;
+    sfc_data << "timeslot,sfc_id,vnf_count,server_count,co_count," <<
+        "path_stretch" << endl;
+
+    // sfcs are needed again for the migration checks
+    map<int, const sfc_request*> sfcs;
+
+    for (int t = 0; t < prob_inst.time_slot_count(); ++t) {
+      // release the sfcs that are expiring at this timeslot
+      for (auto itr = mappings.begin(); itr != mappings.end();) {
+        auto next_itr = next(itr);
+        if (itr->second.timeslot + itr->second.ttl <= t) release(itr);
+        itr = next_itr;
+      }
+      for (auto itr = alive_sfcs.begin(); itr != alive_sfcs.end();) {
+        if (itr->second + sfcs[itr->first]->ttl <= t) {
+          itr = alive_sfcs.erase(itr);
+        }
+        else {
+          ++itr;
+        }
+      }
+
+      // the sfcs that arrived before this timeslot, embedded or not, are
+      // the candidates for migration
+      vector<int> x_sfcs;
+      for (auto& id_arrival : alive_sfcs) x_sfcs.push_back(id_arrival.first);
+
+      // sampled before the new sfcs are embedded, as in run_simulation.py
+      timeslot_data << t << "," << carbon_fp << "," << brown_energy << "," <<
+          green_energy << ",";
+
+      vector<double> path_stretches;
+      int migration_count{0};
+      int server_count, co_count, path_stretch;
+
+      // embed the new sfcs as one batch
+      for (auto& sfc : prob_inst.time_slots[t]) {
+        sfcs[sfc.id] = &sfc;
+        alive_sfcs[sfc.id] = t;
+      }
+      prced_sfc_count += prob_inst.time_slots[t].size();
+      auto results = embed_batch(prob_inst, prob_inst.time_slots[t],
+          green_slot(t), k, order, use_tabu, &ksp_cache,
+          &spt_cache, source);
+      for (auto& result : results) {
+        const auto& sfc = *result.sfc;
+        if (!result.embedded || !accept(sfc, result.emb_nodes,
+            result.mapping, server_count, co_count, path_stretch)) {
+          continue;
+        }
+        running_times.push_back(result.time);
+        result.mapping.timeslot = t;
+        add_to_totals(result.mapping, 1.0);
+        mappings[sfc.id] = result.mapping;
+        ++embed_sfc_count;
+        path_stretches.push_back(path_stretch);
+        sfc_data << t << "," << sfc.id << "," << sfc.vnf_count << "," <<
+            server_count << "," << co_count << "," << path_stretch << endl;
+      }
+      // try to migrate the old ones
+      for (auto sfc_id : x_sfcs) {
+        if (migrate(t, *sfcs[sfc_id])) ++migration_count;
+      }
+
+      timeslot_data << (prced_sfc_count ?
+          embed_sfc_count * 100.0 / prced_sfc_count : 0.0) << ",";
+      timeslot_data << migration_count << ",";
+      if (!path_stretches.empty()) {
+        timeslot_data <<
+            *min_element(path_stretches.begin(), path_stretches.end()) <<
+            "," << percentile(path_stretches, 5) << "," <<
+            accumulate(path_stretches.begin(), path_stretches.end(), 0.0) /
+                path_stretches.size() <<
+            "," << percentile(path_stretches, 95) << "," <<
+            *max_element(path_stretches.begin(), path_stretches.end());
+      }
+      else {
+        timeslot_data << "0.0,0.0,0.0,0.0,0.0";
+      }
+      timeslot_data << endl;
+      cout << t + 1 << "/" << prob_inst.time_slot_count() << " done." <<
+          '\r' << flush;
+    }
+    cout << endl;
+  }
+};
+
+int main(int argc, char **argv) {
+
+  if (argc < 3) {
+    print_usage();
+    return -1;
+  }
+  string dataset_dir {argv[1]};
+  string run_dir {argv[2]};
+  bool use_tabu = true;
+  double migration_threshold = 0.3;
+  batch_order order = batch_order::arrival;
+  path_source source = path_source::shortest;
+  for (int i = 3; i < argc; ++i) {
+    string arg {argv[i]};
+    if (arg == "-f") {
+      use_tabu = false;
+    }
+    else if (arg == "-g") {
+      source = path_source::green_front;
+    }
+    else if (arg == "-m" && i + 1 < argc) {
+      migration_threshold = stod(argv[++i]);
+    }
+    else if (arg == "-o" && i + 1 < argc) {
+      if (!parse_batch_order(argv[++i], order)) {
+        print_usage();
+        return -1;
+      }
+    }
+    else {
+      print_usage();
+      return -1;
+    }
+  }
+  // same number of alternate paths as esso_heuristic.o/esso_firstfit.o
+  int k = use_tabu ? 10 : 2;
+
+  stop_watch sw;
+  sw.start();
+
+  problem_instance prob_inst;
+  if (!prob_inst.read_topology_file(
+          join_path(dataset_dir, "co_topology.dat")) ||
+      !prob_inst.read_vnf_info_file(
+          join_path(dataset_dir, "vnf_types.dat")) ||
+      !prob_inst.read_time_slot_file(
+          join_path(dataset_dir, "timeslots.dat"))) {
+    cerr << "failed to read input files for problem instance" << endl;
+    return -1;
+  }
+
+  mkdir(run_dir.c_str(), 0755);
+  ofstream timeslot_data(join_path(run_dir, "timeslot_data.csv"));
+  ofstream sfc_data(join_path(run_dir, "sfc_data.csv"));
+  if (!timeslot_data || !sfc_data) {
+    cerr << "failed to create output files in " << run_dir << endl;
+    return -1;
+  }
+  timeslot_data << fixed << setprecision(3);
+
+  esso_sim sim(prob_inst, k, use_tabu, migration_threshold, order, source);
+  sim.run(timeslot_data, sfc_data);
+
+  sw.stop();
+  auto& times = sim.running_times;
+  if (!times.empty()) {
+    cout << *min_element(times.begin(), times.end()) << " " <<
+        percentile(times, 5) << " " <<
+        accumulate(times.begin(), times.end(), 0.0) / times.size() << " " <<
+        percentile(times, 50) << " " << percentile(times, 95) << " " <<
+        *max_element(times.begin(), times.end()) << endl;
+  }
+  cout << "time: " << sw << endl;
+  return 0;
+}
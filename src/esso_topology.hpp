@@ -5,9 +5,15 @@
 #include <iostream>
 #include <memory>
 #include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <functional>
 #include <limits>
+#include <tuple>
+#include <unordered_map>
 
 #include "iz_topology.hpp"
+#include "iz_contraction_hierarchy.hpp"
 
 using namespace std;
 
@@ -30,6 +36,11 @@ struct esso_node {
   void activate() {is_active = true;}
   void deactivate() {is_active = false;}
   virtual double get_power() {return 0.0;}
+  // power for the given state instead of the node's own state
+  virtual double get_power(bool active, int cpu_residual) const {
+    return 0.0;
+  }
+  virtual int get_cpu_residual() const {return 0;}
 };
 
 class esso_server : public esso_node {
@@ -57,9 +68,15 @@ public:
   }
 
   double get_power() {
-    if (!is_active) return sleep_power;
+    return get_power(is_active, cpu_residual);
+  }
+
+  double get_power(bool active, int cpu_residual) const {
+    if (!active) return sleep_power;
     return base_power + (cpu_capacity - cpu_residual) * per_cpu_power;
   }
+
+  int get_cpu_residual() const {return cpu_residual;}
 };
 
 struct esso_switch : public esso_node {
@@ -72,7 +89,11 @@ struct esso_switch : public esso_node {
   }
 
   double get_power() {
-    if (!is_active) return sleep_power;
+    return get_power(is_active, 0);
+  }
+
+  double get_power(bool active, int cpu_residual) const {
+    if (!active) return sleep_power;
     double total_power{base_power};
     //for (auto& arc : arcs) {
     //  totalPower += getPortPower(
@@ -82,6 +103,117 @@ struct esso_switch : public esso_node {
   }
 };
 
+// what-if changes to one co: cpu residual and activity of its nodes and
+// residual bandwidth of its links. The co is only read, so evaluations
+// with their own overlays can run concurrently on the same co.
+struct esso_co_overlay {
+  unordered_map<int, int> cpu_residual;
+  unordered_map<int, bool> is_active;
+  izlib::iz_residual_overlay links;
+
+  void clear() {
+    cpu_residual.clear();
+    is_active.clear();
+    links.clear();
+  }
+};
+
+// every simple path between every pair of nodes of a co, ordered so
+// that the first one whose links have the bandwidth is the path
+// iz_topology::shortest_path returns: by latency, then from the target
+// back by the (distance, id) of the nodes, which is the order dijkstra
+// settles the parents in. The cos are built with the same pod, so one
+// table is shared by all of them and a query only checks residuals.
+struct intra_path_table {
+  int node_count;
+  // (u, v, latency) of the links the paths were built from
+  vector<tuple<int, int, int>> links;
+  // paths from u to v in paths[u * node_count + v]
+  vector<izlib::iz_path_list> paths;
+
+  static vector<tuple<int, int, int>> links_of(
+      const izlib::iz_topology& topo) {
+    vector<tuple<int, int, int>> links;
+    for (const auto& edge : topo.edges()) {
+      links.emplace_back(edge.u, edge.v, edge.latency);
+    }
+    return links;
+  }
+
+  explicit intra_path_table(const izlib::iz_topology& topo) :
+      node_count(topo.node_count), links(links_of(topo)),
+      paths(node_count * node_count) {
+    izlib::iz_path path;
+    vector<char> on_path(node_count, false);
+    function<void(int)> extend = [&](int u) {
+      paths[path.nodes.front() * node_count + u].push_back(path);
+      for (int v : topo.neighbors(u)) {
+        if (on_path[v]) continue;
+        on_path[v] = true;
+        path.nodes.push_back(v);
+        path.latency += topo.latency(u, v);
+        extend(v);
+        path.latency -= topo.latency(u, v);
+        path.nodes.pop_back();
+        on_path[v] = false;
+      }
+    };
+    for (int s = 0; s < node_count; ++s) {
+      path = izlib::iz_path(0, 0, {s});
+      on_path[s] = true;
+      extend(s);
+      on_path[s] = false;
+    }
+    auto order_key = [&](const izlib::iz_path& p) {
+      vector<pair<int, int>> key{{p.latency, p.nodes.back()}};
+      int dist = p.latency;
+      for (size_t i = p.size() - 1; i > 0; --i) {
+        dist -= topo.latency(p.nodes[i-1], p.nodes[i]);
+        key.emplace_back(dist, p.nodes[i-1]);
+      }
+      return key;
+    };
+    for (auto& pair_paths : paths) {
+      sort(pair_paths.begin(), pair_paths.end(),
+          [&](const izlib::iz_path& lhs, const izlib::iz_path& rhs) {
+            return order_key(lhs) < order_key(rhs);
+          });
+    }
+  }
+
+  // same as topo.shortest_path(u, v, path, bandwidth, overlay) on the
+  // topology the table was built from
+  void shortest_path(const izlib::iz_topology& topo, int u, int v,
+      izlib::iz_path& path, int bandwidth,
+      const izlib::iz_residual_overlay& overlay) const {
+    path.clear();
+    for (const auto& candidate : paths[u * node_count + v]) {
+      int capacity = numeric_limits<int>::max();
+      for (size_t i = 1; i < candidate.size() && capacity >= bandwidth; ++i) {
+        capacity = min(capacity, overlay.residual(topo,
+            candidate.nodes[i-1], candidate.nodes[i]));
+      }
+      if (capacity >= bandwidth) {
+        path = candidate;
+        path.capacity = capacity;
+        return;
+      }
+    }
+  }
+
+  // table of the pod the first esso_co is built with, shared if pod has
+  // the same links, otherwise a table of its own is built for pod
+  static shared_ptr<const intra_path_table> pod_table(
+      const izlib::iz_topology& pod) {
+    static shared_ptr<const intra_path_table> table =
+        make_shared<intra_path_table>(pod);
+    if (table->node_count == pod.node_count && table->links == links_of(pod)) {
+      return table;
+    }
+    return make_shared<intra_path_table>(pod);
+  }
+};
+
 struct esso_co {
   int id;
   // renewable energy capacity and residual per timeslot
@@ -92,10 +224,19 @@ struct esso_co {
 
   vector<shared_ptr<esso_node>> intra_nodes;
   izlib::iz_topology intra_topo;
+  // candidate paths between the nodes of intra_topo, shared by the cos
+  // with the same pod
+  shared_ptr<const intra_path_table> intra_paths;
   // node 0 is always the gateway/border-router/top-switch
   int border_router;
   int inter_co_node_count;
   std::vector<int> server_ids; // these are the servers
+  // bandwidth allocated on the backbone links of this co, keeps the
+  // border router awake while traffic is entering or leaving the co
+  int backbone_bandwidth{0};
+  // incremented by every change to the cpu, bandwidth or activity of
+  // the co, results computed from the co are valid while it is unchanged
+  unsigned version{0};
   
   /*
   struct server_info {
@@ -145,14 +286,37 @@ struct esso_co {
     for (auto& trsw : tor_switches) {
       add_servers_to_switch(trsw);
     }
+    intra_paths = intra_path_table::pod_table(intra_topo);
   }
 
-  int get_residual_cpu(const int server_id) {
+  // shortest path within the co with at least bandwidth residual, read
+  // from the shared path table instead of searching intra_topo
+  void shortest_path(int u, int v, izlib::iz_path& path, int bandwidth,
+      const izlib::iz_residual_overlay& overlay =
+          izlib::iz_residual_overlay()) const {
+    intra_paths->shortest_path(intra_topo, u, v, path, bandwidth, overlay);
+  }
+
+  int get_residual_cpu(const int server_id) const {
     return dynamic_pointer_cast<esso_server>(
         intra_nodes[server_id])->cpu_residual;
   }
 
+  int get_residual_cpu(const int server_id,
+      const esso_co_overlay& overlay) const {
+    auto itr = overlay.cpu_residual.find(server_id);
+    if (itr != overlay.cpu_residual.end()) return itr->second;
+    return get_residual_cpu(server_id);
+  }
+
+  bool is_active(const int node_id, const esso_co_overlay& overlay) const {
+    auto itr = overlay.is_active.find(node_id);
+    if (itr != overlay.is_active.end()) return itr->second;
+    return intra_nodes[node_id]->is_active;
+  }
+
   void set_residual_cpu(const int server_id, const int cpu_count) {
+    ++version;
     dynamic_pointer_cast<esso_server>(
         intra_nodes.at(server_id))->cpu_capacity = cpu_count;
     dynamic_pointer_cast<esso_server>(
@@ -160,20 +324,32 @@ struct esso_co {
   }
 
   void allocate_cpu(const int server_id, const int cpu_count) {
+    ++version;
     std::dynamic_pointer_cast<esso_server>(
         intra_nodes[server_id])->allocate_cpu(cpu_count);
   }
 
   void release_cpu(const int server_id, const int cpu_count) {
+    ++version;
     std::dynamic_pointer_cast<esso_server>(
         intra_nodes[server_id])->release_cpu(cpu_count);
   }
 
+  // same as allocate_cpu but recorded in the overlay
+  void allocate_cpu(const int server_id, const int cpu_count,
+      esso_co_overlay& overlay) const {
+    overlay.is_active[server_id] = true;
+    overlay.cpu_residual[server_id] =
+        get_residual_cpu(server_id, overlay) - cpu_count;
+  }
+
   void set_residual_bandwidth(int u, int v, int bandwidth) {
+    ++version;
     intra_topo.set_residual_bandwidth(u, v, bandwidth);
   }
   void allocate_bandwidth(const izlib::iz_path& path, 
       const int bandwidth) {
+    ++version;
     for(auto& edge : intra_topo.path_edges(path)) {
       intra_nodes[edge.u]->activate();    
       intra_nodes[edge.v]->activate();    
@@ -182,41 +358,86 @@ struct esso_co {
   }
   void release_bandwidth(const izlib::iz_path& path, 
       const int bandwidth) {
+    ++version;
     for(auto& edge : intra_topo.path_edges(path)) {
-      intra_nodes[edge.u]->deactivate();    
-      intra_nodes[edge.v]->deactivate();    
       intra_topo.release_bandwidth(edge.u, edge.v, bandwidth);
     }
+    // nodes on the path may still be used by other sfcs
+    for (auto node_id : path.nodes) {
+      if (is_idle(node_id)) intra_nodes[node_id]->deactivate();
+    }
   }
 
-  double get_carbon_fp(int time_slot) const {
-    double co_energy{0.0};
-    for (const auto& node : intra_nodes) {
-        co_energy += node->get_power();
+  // same as allocate_bandwidth/release_bandwidth but recorded in the
+  // overlay
+  void allocate_bandwidth(const izlib::iz_path& path, const int bandwidth,
+      esso_co_overlay& overlay) const {
+    for (size_t i = 1; i < path.size(); ++i) {
+      int u = path.nodes[i-1], v = path.nodes[i];
+      overlay.is_active[u] = true;
+      overlay.is_active[v] = true;
+      overlay.links.allocate_bandwidth(intra_topo, u, v, bandwidth);
     }
-    for (const auto& edge : intra_topo.edges()) {
-      if (edge.consumed_bandwidth() > 0) {
-        if (edge.consumed_bandwidth() <= 1000) {
-          co_energy += 0.0012; 
-        }
-        else {
-          co_energy += 0.0043;
-        }
-      }
+  }
+  void release_bandwidth(const izlib::iz_path& path, const int bandwidth,
+      esso_co_overlay& overlay) const {
+    for (size_t i = 1; i < path.size(); ++i) {
+      overlay.links.release_bandwidth(intra_topo, path.nodes[i-1],
+          path.nodes[i], bandwidth);
     }
-    co_energy = max(0.0, co_energy - green_residual[time_slot]);
-    return co_energy * carbon;
+    for (auto node_id : path.nodes) {
+      if (is_idle(node_id, overlay)) overlay.is_active[node_id] = false;
+    }
+  }
+
+  // a node can sleep only if none of its links carry traffic and, for a
+  // server, no cpu is allocated on it
+  bool is_idle(const int node_id) const {
+    return is_idle(node_id, esso_co_overlay());
+  }
+
+  bool is_idle(const int node_id, const esso_co_overlay& overlay) const {
+    if (node_id == border_router && backbone_bandwidth > 0) return false;
+    for (const auto& edge : intra_topo.edges(node_id)) {
+      if (edge.capacity >
+          overlay.links.residual(intra_topo, edge.u, edge.v)) return false;
+    }
+    auto server = dynamic_pointer_cast<esso_server>(intra_nodes[node_id]);
+    return !server ||
+        get_residual_cpu(node_id, overlay) == server->cpu_capacity;
+  }
+
+  double get_carbon_fp(int time_slot) const {
+    double brown_energy, green_energy;
+    return get_carbon_fp(time_slot, brown_energy, green_energy);
   }
 
   double get_carbon_fp(int time_slot, 
       double& brown_energy, double& green_energy) const {
+    return get_carbon_fp(time_slot, brown_energy, green_energy,
+        esso_co_overlay());
+  }
+
+  double get_carbon_fp(int time_slot, const esso_co_overlay& overlay) const {
+    double brown_energy, green_energy;
+    return get_carbon_fp(time_slot, brown_energy, green_energy, overlay);
+  }
+
+  double get_carbon_fp(int time_slot, double& brown_energy,
+      double& green_energy, const esso_co_overlay& overlay) const {
     double co_energy{0.0};
     for (const auto& node : intra_nodes) {
-        co_energy += node->get_power();
+      auto itr = overlay.cpu_residual.find(node->id);
+      int cpu_residual = itr != overlay.cpu_residual.end() ?
+          itr->second : node->get_cpu_residual();
+      co_energy += node->get_power(is_active(node->id, overlay),
+          cpu_residual);
     }
     for (const auto& edge : intra_topo.edges()) {
-      if (edge.consumed_bandwidth() > 0) {
-        if (edge.consumed_bandwidth() <= 1000) {
+      int consumed_bandwidth = edge.capacity -
+          overlay.links.residual(intra_topo, edge.u, edge.v);
+      if (consumed_bandwidth > 0) {
+        if (consumed_bandwidth <= 1000) {
           co_energy += 0.0012; 
         }
         else {
@@ -258,59 +479,53 @@ struct esso_co {
     }
   }
 
-  void compute_embedding_cost(const vector<int> cpu_reqs, 
+  // fills cost_matrix[i][j] with the cost of embedding vnfs i..j of the
+  // chain in this co and node_matrix[i][j] with the server of vnf j. The
+  // partial embeddings are only recorded in an overlay, the co is not
+  // modified.
+  void compute_embedding_cost(const vector<int>& cpu_reqs, 
     const int bandwidth, const int time_slot, 
-    vector<vector<double>>& cost_matrix, vector<vector<int>>& node_matrix) {
+    vector<vector<double>>& cost_matrix,
+    vector<vector<int>>& node_matrix) const {
 
     // cost_matrix is used to hold the cost of all partial
     // allocations
     cost_matrix.resize(cpu_reqs.size(), vector<double>(cpu_reqs.size(), -1.0));
     node_matrix.resize(cpu_reqs.size(), vector<int>(cpu_reqs.size(), -1));
 
-    // used to save info about pseudo allocation
-    vector<pair<int, int>> pseudo_cpu_alloc;
-    vector<pair<izlib::iz_path, int>> pseudo_bandwidth_alloc;
+    // holds the pseudo allocations
+    esso_co_overlay overlay;
 
     // temp variables
     izlib::iz_path f_path, r_path;
 
     // current cost
     double cost_before_alloc {get_carbon_fp(time_slot)}, new_cost;
-    //double cost_before_alloc {}, new_cost;
 
     // loop to generate all possile partial embeddings
     for (size_t i = 0; i < cpu_reqs.size(); ++i) {
       // for each j, we can build on the previously computed cost
-      // so pseudo alloc vectors are cleared only here
-      pseudo_cpu_alloc.clear();
-      pseudo_bandwidth_alloc.clear();
+      // so the overlay is cleared only here
+      overlay.clear();
       // each j represent a new partial chain embedding, so
       // last_node is initialized to border_router
       int last_node{border_router};
       // loop to generate all possible partial embeddings
       for (size_t j = i; j < cpu_reqs.size(); ++j) {
-        //embedding_found = true;
         // if the last node is not the border router then 
         // we have embedded at least one vnf, then the last
         // server is our first candidate
         vector<int> candidate_servers;
         if (last_node != border_router && 
-            get_residual_cpu(last_node) >= cpu_reqs[j]) {
+            get_residual_cpu(last_node, overlay) >= cpu_reqs[j]) {
           candidate_servers.push_back(last_node);
         }
         // now we filter all other servers with enough capacity
         copy_if(server_ids.begin(), server_ids.end(),
             back_inserter(candidate_servers), 
             [&] (int server_id) {
-                return (get_residual_cpu(server_id) >= cpu_reqs[j]);
+                return (get_residual_cpu(server_id, overlay) >= cpu_reqs[j]);
             });
-        /*
-        for (auto sid : server_ids) {
-          if (sid == last_node) continue;
-          if (get_residual_cpu(sid) >= cpu_reqs[j])
-            candidate_servers.push_back(sid);
-        }
-        */
 
         if (candidate_servers.empty()) {
           break;
@@ -321,14 +536,14 @@ struct esso_co {
         for (const auto& cs : candidate_servers) {
           // path from last node to candidate server
           if (cs != last_node) {
-            intra_topo.shortest_path(last_node, cs, f_path, bandwidth);
+            shortest_path(last_node, cs, f_path, bandwidth, overlay.links);
             if (!f_path.is_valid()) continue;
           }
           // return path from candidate server to border router
-          intra_topo.shortest_path(cs, border_router, r_path, bandwidth);
+          shortest_path(cs, border_router, r_path, bandwidth,
+              overlay.links);
           if (!r_path.is_valid()) continue;
           // embedding found
-          //cerr << f_path << endl << r_path << endl;
           server_id = cs;
           break;
         }
@@ -340,32 +555,20 @@ struct esso_co {
         // update the node matrix
         node_matrix[i][j] = server_id;
         // allocate server resources
-        allocate_cpu(server_id, cpu_reqs[j]);
-        pseudo_cpu_alloc.push_back(make_pair(server_id, cpu_reqs[j]));
+        allocate_cpu(server_id, cpu_reqs[j], overlay);
         // allocate bandwidth resources
         if (last_node != server_id) {
-          allocate_bandwidth(f_path, bandwidth);
-          pseudo_bandwidth_alloc.push_back(make_pair(f_path, bandwidth));  
+          allocate_bandwidth(f_path, bandwidth, overlay);
         }
-        allocate_bandwidth(r_path, bandwidth);
-        pseudo_bandwidth_alloc.push_back(make_pair(r_path, bandwidth));
+        allocate_bandwidth(r_path, bandwidth, overlay);
         // now calculate the cost and update cost matrix
-        new_cost = get_carbon_fp(time_slot);
+        new_cost = get_carbon_fp(time_slot, overlay);
         cost_matrix[i][j] = new_cost - cost_before_alloc;
-        // remove and release the bandwidth for the return path
-        auto return_path_pair = pseudo_bandwidth_alloc.back();
-        pseudo_bandwidth_alloc.pop_back();
-        release_bandwidth(return_path_pair.first, return_path_pair.second);
+        // release the bandwidth for the return path
+        release_bandwidth(r_path, bandwidth, overlay);
         // update last_node for the next iteration
         last_node = server_id;
       } // end of j's loop
-      // release the pseudo allocation resources
-      for (auto& server_cpu : pseudo_cpu_alloc) {
-        release_cpu(server_cpu.first, server_cpu.second);
-      }
-      for (auto& path_bandwidth : pseudo_bandwidth_alloc) {
-        release_bandwidth(path_bandwidth.first, path_bandwidth.second);
-      }
     } // end of i's loop
   }
 };
@@ -374,28 +577,62 @@ struct esso_topology {
   vector<esso_co> cos; 
   izlib::iz_topology inter_co_topo;
   double carbon = 1.12;
+  // incremented by every change to the backbone links
+  unsigned backbone_version{0};
+  // shortest backbone latencies. The latencies never change during a
+  // run, only the residuals do, so the index is built once the links
+  // are added.
+  izlib::iz_contraction_hierarchy latency_index;
+  // backbone latencies of all cos to a co, by target co, filled on demand
+  unordered_map<int, vector<int>> latencies_to_co;
+
+  // version of the whole topology. It changes with every allocation or
+  // release, so a state read at one version is consistent as long as the
+  // version is unchanged. Searches only read the topology (what-if
+  // evaluations go to overlays), so they can run concurrently between
+  // two commits.
+  unsigned long long version() const {
+    unsigned long long v = backbone_version;
+    for (const auto& co : cos) v += co.version;
+    return v;
+  }
   
   void init(int node_count) {
     inter_co_topo.init(node_count);
   }
 
   void set_residual_bandwidth(int u, int v, int bandwidth) {
+    ++backbone_version;
     inter_co_topo.set_residual_bandwidth(u, v, bandwidth);
   }
 
   void allocate_bandwidth(const izlib::iz_path& path, 
       const int bandwidth) {
+    ++backbone_version;
     for(auto& edge : inter_co_topo.path_edges(path)) {
       cos[edge.u].intra_nodes[0]->activate();
       cos[edge.v].intra_nodes[0]->activate();
+      cos[edge.u].backbone_bandwidth += bandwidth;
+      cos[edge.v].backbone_bandwidth += bandwidth;
+      ++cos[edge.u].version;
+      ++cos[edge.v].version;
       inter_co_topo.allocate_bandwidth(edge.u, edge.v, bandwidth);
     }
   }
   void release_bandwidth(const izlib::iz_path& path, 
       const int bandwidth) {
+    ++backbone_version;
     for(auto& edge : inter_co_topo.path_edges(path)) {
+      cos[edge.u].backbone_bandwidth -= bandwidth;
+      cos[edge.v].backbone_bandwidth -= bandwidth;
+      ++cos[edge.u].version;
+      ++cos[edge.v].version;
       inter_co_topo.release_bandwidth(edge.u, edge.v, bandwidth);
     }
+    for (auto co_id : path.nodes) {
+      auto& co = cos[co_id];
+      if (co.is_idle(co.border_router)) co.intra_nodes[0]->deactivate();
+    }
   }
 
   int add_co(vector<double>& green_capacity, double carbon = 1.2) {
@@ -405,9 +642,40 @@ struct esso_topology {
   }
 
   void add_edge(int u, int v, int latency, int capacity) {
+    latency_index.clear();
+    latencies_to_co.clear();
     inter_co_topo.add_edge(u, v, latency, capacity);
   }
 
+  void build_latency_index() {
+    latency_index.build(inter_co_topo);
+  }
+
+  // latency of the shortest backbone path between two cos, no_latency_bound
+  // if there is none. The index answers it unless a bandwidth is asked
+  // for, then the links with that residual are searched.
+  int backbone_latency(int co_u, int co_v, int bandwidth = 0) const {
+    if (bandwidth == 0 && !latency_index.empty()) {
+      return latency_index.latency(co_u, co_v);
+    }
+    izlib::iz_path path;
+    inter_co_topo.shortest_path(co_u, co_v, path, bandwidth);
+    return path.is_valid() ?
+        path.latency : izlib::iz_topology::no_latency_bound;
+  }
+
+  // latencies of all cos to co_t over any backbone links, a lower bound
+  // for the searches that need bandwidth. Computed once per co_t, so it
+  // must not be called concurrently.
+  const vector<int>& backbone_latencies_to(int co_t) {
+    auto& latencies = latencies_to_co[co_t];
+    if (latencies.empty()) {
+      vector<int> parent;
+      inter_co_topo.shortest_path_tree(co_t, 0, parent, latencies);
+    }
+    return latencies;
+  }
+
   double get_backbone_carbon_fp(int time_slot, double& brown_energy) const {
     double brown_power{0.0};
     for (const auto& edge : inter_co_topo.edges()) {
@@ -425,7 +693,7 @@ struct esso_topology {
   }
 
   double get_carbon_fp(int time_slot, 
-      double& brown_energy, double& green_energy ) {
+      double& brown_energy, double& green_energy ) const {
     double carbon_fp{0}, be, ge, bge;
     brown_energy = 0;
     green_energy = 0;
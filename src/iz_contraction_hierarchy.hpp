@@ -0,0 +1,224 @@
+#ifndef IZ_CONTRACTION_HIERARCHY_HPP_
+#define IZ_CONTRACTION_HIERARCHY_HPP_
+
+#include <queue>
+#include <vector>
+#include <limits>
+#include <cassert>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+
+#include "iz_topology.hpp"
+
+namespace izlib {
+
+  // contraction hierarchy over the latencies of a topology, for queries
+  // that only need the latency of the shortest path. Nodes are
+  // contracted in order of edge difference and shortcuts keep the
+  // latencies between the remaining nodes, so a query is two searches
+  // that only go up the hierarchy. Once the lowest node has too many
+  // links the remaining nodes are left as a core whose links go both
+  // ways, the searches meet in it like a bidirectional dijkstra.
+  // Residuals are not looked at, queries that need a capacity have to
+  // search the topology. A topology that gets new edges needs a new
+  // build.
+  class iz_contraction_hierarchy {
+      // edges to higher ranked nodes, original ones and shortcuts, in
+      // up_targets/up_latencies[up_offsets[u] .. up_offsets[u+1])
+      std::vector<int> up_offsets, up_targets, up_latencies;
+      // witness searches settle at most this many nodes, a shortcut is
+      // added if they give up
+      static const int witness_settle_limit = 256;
+      // nodes with more links than this are not contracted
+      static const int max_contract_degree = 16;
+
+      struct query_workspace {
+        std::vector<unsigned> stamp[2];
+        std::vector<int> dist[2];
+        unsigned epoch{0};
+      };
+    public:
+      iz_contraction_hierarchy() {}
+      explicit iz_contraction_hierarchy(const iz_topology& topo) {
+        build(topo);
+      }
+      void build(const iz_topology& topo);
+      void clear() {
+        up_offsets.clear();
+        up_targets.clear();
+        up_latencies.clear();
+      }
+      bool empty() const {return up_offsets.empty();}
+      int node_count() const {
+        return empty() ? 0 : static_cast<int>(up_offsets.size()) - 1;
+      }
+      // latency of the shortest path from s to t, no_latency_bound if t
+      // cannot be reached. Can be called concurrently.
+      int latency(int s, int t) const;
+  };
+
+  void iz_contraction_hierarchy::build(const iz_topology& topo) {
+    int n = topo.node_count;
+    // remaining graph, the lowest latency of the parallel edges
+    std::vector<std::unordered_map<int, int>> adj(n);
+    auto add_link = [&](int u, int v, int latency) {
+      auto itr = adj[u].find(v);
+      if (itr != adj[u].end() && itr->second <= latency) return;
+      adj[u][v] = latency;
+      adj[v][u] = latency;
+    };
+    for (auto& edge : topo.edges()) {
+      if (edge.u != edge.v) add_link(edge.u, edge.v, edge.latency);
+    }
+
+    // witness search from u in the remaining graph without v: is there
+    // a path to w no longer than via
+    std::vector<unsigned> stamp(n, 0);
+    std::vector<int> dist(n);
+    unsigned epoch{0};
+    auto has_witness = [&](int u, int w, int v, int via) {
+      ++epoch;
+      typedef std::pair<int, int> dist_node;
+      std::priority_queue<dist_node, std::vector<dist_node>,
+          std::greater<dist_node>> pq;
+      stamp[u] = epoch;
+      dist[u] = 0;
+      pq.emplace(0, u);
+      int settled{0};
+      while (!pq.empty() && settled < witness_settle_limit) {
+        int d = pq.top().first, x = pq.top().second;
+        pq.pop();
+        if (d != dist[x]) continue;
+        if (d > via) return false;
+        if (x == w) return true;
+        ++settled;
+        for (auto& link : adj[x]) {
+          int y = link.first;
+          if (y == v) continue;
+          int dy = d + link.second;
+          if (dy > via) continue;
+          if (stamp[y] != epoch || dist[y] > dy) {
+            stamp[y] = epoch;
+            dist[y] = dy;
+            pq.emplace(dy, y);
+          }
+        }
+      }
+      return false;
+    };
+    // shortcuts needed to contract v, added if add is set
+    auto shortcuts = [&](int v, bool add) {
+      std::vector<std::pair<int, int>> links(adj[v].begin(), adj[v].end());
+      int count{0};
+      for (size_t i = 0; i < links.size(); ++i) {
+        for (size_t j = i + 1; j < links.size(); ++j) {
+          int via = links[i].second + links[j].second;
+          if (has_witness(links[i].first, links[j].first, v, via)) continue;
+          ++count;
+          if (add) add_link(links[i].first, links[j].first, via);
+        }
+      }
+      return count;
+    };
+
+    std::vector<int> deleted_neighbors(n, 0);
+    auto priority = [&](int v) {
+      return shortcuts(v, false) - static_cast<int>(adj[v].size()) +
+          deleted_neighbors[v];
+    };
+    typedef std::pair<int, int> priority_node;
+    std::priority_queue<priority_node, std::vector<priority_node>,
+        std::greater<priority_node>> order;
+    for (int v = 0; v < n; ++v) order.emplace(priority(v), v);
+
+    std::vector<std::vector<std::pair<int, int>>> up(n);
+    while (!order.empty()) {
+      int v = order.top().second;
+      if (static_cast<int>(adj[v].size()) > max_contract_degree) break;
+      order.pop();
+      // priorities go stale as neighbors are contracted, v waits if it
+      // is no longer the lowest
+      int p = priority(v);
+      if (!order.empty() && p > order.top().first) {
+        order.emplace(p, v);
+        continue;
+      }
+      shortcuts(v, true);
+      up[v].assign(adj[v].begin(), adj[v].end());
+      for (auto& link : up[v]) {
+        adj[link.first].erase(v);
+        ++deleted_neighbors[link.first];
+      }
+      adj[v].clear();
+    }
+    // the core
+    for (int v = 0; v < n; ++v) {
+      if (!adj[v].empty()) up[v].assign(adj[v].begin(), adj[v].end());
+    }
+
+    up_offsets.assign(n + 1, 0);
+    up_targets.clear();
+    up_latencies.clear();
+    for (int v = 0; v < n; ++v) {
+      for (auto& link : up[v]) {
+        up_targets.push_back(link.first);
+        up_latencies.push_back(link.second);
+      }
+      up_offsets[v + 1] = up_targets.size();
+    }
+  }
+
+  // upward searches from s and t, alternating on the smaller distance.
+  // A side stops once its queue cannot improve on the best meeting.
+  int iz_contraction_hierarchy::latency(int s, int t) const {
+    assert(s >= 0 && s < node_count());
+    assert(t >= 0 && t < node_count());
+    thread_local query_workspace ws;
+    for (int side = 0; side < 2; ++side) {
+      if (ws.stamp[side].size() < up_offsets.size()) {
+        ws.stamp[side].resize(up_offsets.size(), 0);
+        ws.dist[side].resize(up_offsets.size());
+      }
+    }
+    if (++ws.epoch == 0) {
+      for (auto& stamp : ws.stamp) std::fill(stamp.begin(), stamp.end(), 0);
+      ws.epoch = 1;
+    }
+    typedef std::pair<int, int> dist_node;
+    std::priority_queue<dist_node, std::vector<dist_node>,
+        std::greater<dist_node>> pq[2];
+    int source[2] = {s, t};
+    for (int side = 0; side < 2; ++side) {
+      ws.stamp[side][source[side]] = ws.epoch;
+      ws.dist[side][source[side]] = 0;
+      pq[side].emplace(0, source[side]);
+    }
+    int best = iz_topology::no_latency_bound;
+    auto is_done = [&](int side) {
+      return pq[side].empty() || pq[side].top().first >= best;
+    };
+    while (!is_done(0) || !is_done(1)) {
+      int side = is_done(0) ? 1 : is_done(1) ? 0 :
+          pq[0].top().first <= pq[1].top().first ? 0 : 1;
+      int d = pq[side].top().first, u = pq[side].top().second;
+      pq[side].pop();
+      if (d != ws.dist[side][u]) continue;
+      if (ws.stamp[1 - side][u] == ws.epoch) {
+        best = std::min(best, d + ws.dist[1 - side][u]);
+      }
+      for (int i = up_offsets[u]; i < up_offsets[u + 1]; ++i) {
+        int v = up_targets[i], dv = d + up_latencies[i];
+        if (ws.stamp[side][v] != ws.epoch || ws.dist[side][v] > dv) {
+          ws.stamp[side][v] = ws.epoch;
+          ws.dist[side][v] = dv;
+          pq[side].emplace(dv, v);
+        }
+      }
+    }
+    return best;
+  }
+
+} // end of namespace izlib
+
+#endif
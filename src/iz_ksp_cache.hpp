@@ -0,0 +1,88 @@
+#ifndef IZ_KSP_CACHE_HPP_
+#define IZ_KSP_CACHE_HPP_
+
+#include <map>
+#include <tuple>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include "iz_topology.hpp"
+
+namespace izlib {
+
+  // k shortest path generators kept per (s, t, bandwidth) across queries.
+  // The paths over the links with at least bandwidth residual only change
+  // when that set of links changes, so an entry is reused as long as the
+  // links on its paths and candidates still have the bandwidth and the
+  // links that did not have it still do not. The check is skipped while
+  // the residual version of the topology is unchanged. Paths are kept
+  // with the capacity they had when they were generated, callers that
+  // need the current one update the metrics. clear() is needed after
+  // edges are added to or removed from the topology.
+  class iz_ksp_cache {
+      struct entry {
+        std::unique_ptr<iz_ksp_generator> ksp;
+        // links below the bandwidth when the generator was created
+        std::vector<std::pair<int, int>> blocked;
+        // residual version the entry was last known valid at
+        unsigned long long version;
+      };
+      const iz_topology& topo;
+      std::map<std::tuple<int, int, int>, entry> entries;
+      int hit_count, miss_count;
+
+      bool is_valid(const entry& e, int bandwidth) const;
+    public:
+      explicit iz_ksp_cache(const iz_topology& topo) :
+          topo(topo), hit_count{0}, miss_count{0} {}
+      // generator of the paths from s to t with at least bandwidth
+      // residual, valid until the topology changes
+      iz_ksp_generator& paths(int s, int t, int bandwidth);
+      void clear() {entries.clear();}
+      int hits() const {return hit_count;}
+      int misses() const {return miss_count;}
+  };
+
+  bool iz_ksp_cache::is_valid(const entry& e, int bandwidth) const {
+    auto has_bandwidth = [&](const iz_path_list& paths) {
+      for (auto& path : paths) {
+        for (size_t i = 1; i < path.size(); ++i) {
+          if (topo.residual(path.nodes[i-1], path.nodes[i]) < bandwidth) {
+            return false;
+          }
+        }
+      }
+      return true;
+    };
+    if (!has_bandwidth(e.ksp->paths()) ||
+        !has_bandwidth(e.ksp->candidate_paths())) {
+      return false;
+    }
+    for (auto& link : e.blocked) {
+      if (topo.residual(link.first, link.second) >= bandwidth) return false;
+    }
+    return true;
+  }
+
+  iz_ksp_generator& iz_ksp_cache::paths(int s, int t, int bandwidth) {
+    auto& e = entries[std::make_tuple(s, t, bandwidth)];
+    if (e.ksp && (e.version == topo.residual_version() ||
+        is_valid(e, bandwidth))) {
+      ++hit_count;
+    }
+    else {
+      ++miss_count;
+      e.ksp.reset(new iz_ksp_generator(topo, s, t, bandwidth));
+      e.blocked.clear();
+      for (auto& edge : topo.edges()) {
+        if (edge.residual < bandwidth) e.blocked.emplace_back(edge.u, edge.v);
+      }
+    }
+    e.version = topo.residual_version();
+    return *e.ksp;
+  }
+
+} // end of namespace izlib
+
+#endif
@@ -2,6 +2,9 @@
 #define IZ_PRIORITY_QUEUE_H
 
 #include <vector>
+#include <cassert>
+#include <algorithm>
+#include <functional>
 #include <unordered_map>
 
 //#include <iostream>
@@ -122,6 +125,107 @@ namespace izlib {
     
       int size() const {return heap.size();}
       bool empty() const {return size() == 0;}
+      void clear() {
+        heap.clear();
+        item_to_heap_index.clear();
+      }
+  };
+
+  // dense integer items, such as node ids: the heap index of an item is
+  // kept in an array indexed by the item instead of a hash map, and the
+  // heap is 4-ary with iterative sifts. Items are popped in the same
+  // order as from the generic queue. The arrays keep their memory across
+  // clear(), so a queue that is reused does not allocate once it has
+  // grown to the largest item.
+  template <class key_type, class compare, class item_type_hash>
+  class iz_priority_queue<int, key_type, compare, item_type_hash> {
+      struct pq_item {
+        int item;
+        key_type key;
+      };
+      std::vector<pq_item> heap;
+      // heap index of every item, -1 if it is not in the queue
+      std::vector<int> heap_index;
+      static const int arity = 4;
+
+      // by key, then by item
+      static bool is_before(const pq_item& lhs, const pq_item& rhs) {
+        if (compare()(lhs.key, rhs.key)) return true;
+        if (compare()(rhs.key, lhs.key)) return false;
+        return lhs.item < rhs.item;
+      }
+      void place(const pq_item& entry, int index) {
+        heap[index] = entry;
+        heap_index[entry.item] = index;
+      }
+      void shift_up(int index) {
+        pq_item entry = heap[index];
+        while (index > 0) {
+          int parent = (index - 1) / arity;
+          if (!is_before(entry, heap[parent])) break;
+          place(heap[parent], index);
+          index = parent;
+        }
+        place(entry, index);
+      }
+      void shift_down(int index) {
+        pq_item entry = heap[index];
+        int count = heap.size();
+        while (true) {
+          int first = arity * index + 1;
+          if (first >= count) break;
+          int smallest = first;
+          int last = std::min(first + arity, count);
+          for (int child = first + 1; child < last; ++child) {
+            if (is_before(heap[child], heap[smallest])) smallest = child;
+          }
+          if (!is_before(heap[smallest], entry)) break;
+          place(heap[smallest], index);
+          index = smallest;
+        }
+        place(entry, index);
+      }
+    public:
+      void push(int item, const key_type& key) {
+        assert(item >= 0);
+        if (static_cast<size_t>(item) >= heap_index.size()) {
+          heap_index.resize(item + 1, -1);
+        }
+        heap.push_back(pq_item{item, key});
+        shift_up(heap.size() - 1);
+      }
+      int top() const {
+        return heap.front().item;
+      }
+      key_type top_key() const {
+        return heap.front().key;
+      }
+      void pop() {
+        heap_index[heap.front().item] = -1;
+        pq_item last = heap.back();
+        heap.pop_back();
+        if (heap.empty()) return;
+        heap[0] = last;
+        shift_down(0);
+      }
+      bool update_key(int item, const key_type& new_key) {
+        if (item < 0 || static_cast<size_t>(item) >= heap_index.size() ||
+            heap_index[item] == -1) {
+          return false;
+        }
+        int index = heap_index[item];
+        key_type old_key = heap[index].key;
+        heap[index].key = new_key;
+        if (compare()(old_key, new_key)) shift_down(index);
+        else shift_up(index);
+        return true;
+      }
+      int size() const {return heap.size();}
+      bool empty() const {return heap.empty();}
+      void clear() {
+        for (auto& entry : heap) heap_index[entry.item] = -1;
+        heap.clear();
+      }
   };
 }
 #endif
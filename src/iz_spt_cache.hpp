@@ -0,0 +1,101 @@
+#ifndef IZ_SPT_CACHE_HPP_
+#define IZ_SPT_CACHE_HPP_
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "iz_topology.hpp"
+
+namespace izlib {
+
+  // shortest path trees kept per (source, bandwidth), one search answers
+  // the paths to every target and a path is read back from the tree in
+  // O(path length). The tree only changes when the set of links with at
+  // least bandwidth residual changes: a path is still the shortest one
+  // as long as its links keep the bandwidth and no link that was below
+  // it got it back, links that dropped below it elsewhere can only make
+  // other paths longer. The check is skipped while the residual version
+  // of the topology is unchanged. clear() is needed after edges are
+  // added to or removed from the topology.
+  class iz_spt_cache {
+      struct entry {
+        std::vector<int> parent, latencies;
+        // links below the bandwidth when the tree was built
+        std::vector<std::pair<int, int>> blocked;
+        // residual version the tree was built at
+        unsigned long long version;
+      };
+      const iz_topology& topo;
+      std::map<std::pair<int, int>, entry> entries;
+      int hit_count, miss_count;
+
+      void tree_path(const entry& e, int s, int t, iz_path& path) const;
+      bool is_valid(const entry& e, int bandwidth, const iz_path& path) const;
+      void build(entry& e, int s, int bandwidth);
+    public:
+      explicit iz_spt_cache(const iz_topology& topo) :
+          topo(topo), hit_count{0}, miss_count{0} {}
+      // same path as topo.shortest_path(s, t, path, bandwidth), with the
+      // current capacity. path is left empty if t cannot be reached.
+      void shortest_path(int s, int t, int bandwidth, iz_path& path);
+      void clear() {entries.clear();}
+      int hits() const {return hit_count;}
+      int misses() const {return miss_count;}
+  };
+
+  void iz_spt_cache::tree_path(const entry& e, int s, int t,
+      iz_path& path) const {
+    path.clear();
+    if (e.parent[t] == -1) return;
+    path.latency = e.latencies[t];
+    for (int v = t; v != s; v = e.parent[v]) path.nodes.push_back(v);
+    path.nodes.push_back(s);
+    std::reverse(path.nodes.begin(), path.nodes.end());
+  }
+
+  bool iz_spt_cache::is_valid(const entry& e, int bandwidth,
+      const iz_path& path) const {
+    for (size_t i = 1; i < path.size(); ++i) {
+      if (topo.residual(path.nodes[i-1], path.nodes[i]) < bandwidth) {
+        return false;
+      }
+    }
+    for (auto& link : e.blocked) {
+      if (topo.residual(link.first, link.second) >= bandwidth) return false;
+    }
+    return true;
+  }
+
+  void iz_spt_cache::build(entry& e, int s, int bandwidth) {
+    topo.shortest_path_tree(s, bandwidth, e.parent, e.latencies);
+    e.blocked.clear();
+    for (auto& edge : topo.edges()) {
+      if (edge.residual < bandwidth) e.blocked.emplace_back(edge.u, edge.v);
+    }
+    e.version = topo.residual_version();
+  }
+
+  void iz_spt_cache::shortest_path(int s, int t, int bandwidth,
+      iz_path& path) {
+    auto& e = entries[std::make_pair(s, bandwidth)];
+    if (!e.parent.empty()) {
+      tree_path(e, s, t, path);
+      // an unreachable target could have become reachable
+      if (e.version == topo.residual_version() ||
+          (path.is_valid() && is_valid(e, bandwidth, path))) {
+        ++hit_count;
+        if (path.is_valid()) topo.update_path_metrics(path);
+        return;
+      }
+    }
+    ++miss_count;
+    build(e, s, bandwidth);
+    tree_path(e, s, t, path);
+    if (path.is_valid()) topo.update_path_metrics(path);
+  }
+
+} // end of namespace izlib
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef IZ_THREAD_POOL_HPP_
+#define IZ_THREAD_POOL_HPP_
+
+#include <queue>
+#include <cstdlib>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+namespace izlib {
+
+  // fixed size pool of worker threads. parallel_for is the only way work
+  // is handed out; the calling thread takes part in the loop, so a
+  // parallel_for issued from inside a worker cannot deadlock the pool.
+  class iz_thread_pool {
+      std::vector<std::thread> workers;
+      std::queue<std::function<void()>> tasks;
+      std::mutex tasks_mutex;
+      std::condition_variable tasks_cv;
+      bool stopping;
+
+      void worker_loop();
+      void enqueue(std::function<void()> task);
+    public:
+      // thread_count is the number of threads running a loop, including
+      // the caller, so a pool of 1 runs everything on the caller
+      explicit iz_thread_pool(int thread_count = default_thread_count());
+      ~iz_thread_pool();
+      iz_thread_pool(const iz_thread_pool&) = delete;
+      iz_thread_pool& operator=(const iz_thread_pool&) = delete;
+
+      int thread_count() const {return workers.size() + 1;}
+
+      // calls fn(i) for every i in [0, n) and returns once all are done.
+      // The order of the calls is unspecified, fn must be safe to call
+      // concurrently for different i.
+      template <class loop_fn>
+      void parallel_for(int n, loop_fn fn);
+
+      // IZ_THREADS overrides the number of hardware threads
+      static int default_thread_count() {
+        const char* env = std::getenv("IZ_THREADS");
+        if (env && std::atoi(env) > 0) return std::atoi(env);
+        return std::max(1u, std::thread::hardware_concurrency());
+      }
+      // pool shared by the whole program
+      static iz_thread_pool& shared() {
+        static iz_thread_pool pool;
+        return pool;
+      }
+  };
+
+  iz_thread_pool::iz_thread_pool(int thread_count) : stopping{false} {
+    for (int i = 1; i < thread_count; ++i) {
+      workers.emplace_back(&iz_thread_pool::worker_loop, this);
+    }
+  }
+
+  iz_thread_pool::~iz_thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex);
+      stopping = true;
+    }
+    tasks_cv.notify_all();
+    for (auto& worker : workers) worker.join();
+  }
+
+  void iz_thread_pool::worker_loop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(tasks_mutex);
+        tasks_cv.wait(lock, [this] {return stopping || !tasks.empty();});
+        if (stopping && tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+      task();
+    }
+  }
+
+  void iz_thread_pool::enqueue(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex);
+      tasks.push(std::move(task));
+    }
+    tasks_cv.notify_one();
+  }
+
+  template <class loop_fn>
+  void iz_thread_pool::parallel_for(int n, loop_fn fn) {
+    if (n <= 0) return;
+    if (n == 1 || workers.empty()) {
+      for (int i = 0; i < n; ++i) fn(i);
+      return;
+    }
+    // helpers that are dequeued after the loop is over find no index
+    // left and return without touching fn, so the loop state is shared
+    struct loop_state {
+      std::atomic<int> next_index{0};
+      std::atomic<int> done_count{0};
+      std::mutex done_mutex;
+      std::condition_variable done_cv;
+    };
+    auto state = std::make_shared<loop_state>();
+    loop_fn* fn_ptr = &fn;
+    auto run = [state, fn_ptr, n]() {
+      for (int i = state->next_index++; i < n; i = state->next_index++) {
+        (*fn_ptr)(i);
+        if (++state->done_count == n) {
+          std::lock_guard<std::mutex> lock(state->done_mutex);
+          state->done_cv.notify_all();
+        }
+      }
+    };
+    int helper_count = std::min<int>(n - 1, workers.size());
+    for (int i = 0; i < helper_count; ++i) enqueue(run);
+    run();
+    std::unique_lock<std::mutex> lock(state->done_mutex);
+    state->done_cv.wait(lock, [&] {return state->done_count == n;});
+  }
+
+} // end of namespace izlib
+
+#endif
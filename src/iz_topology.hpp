@@ -5,14 +5,19 @@
 #include <queue>
 #include <vector>
 #include <limits>
+#include <cstdlib>
 #include <cassert>
+#include <cstdint>
 #include <algorithm>
+#include <functional>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <iostream>
 //using namespace std;
 
 #include "iz_priority_queue.hpp"
+#include "iz_thread_pool.hpp"
 
 namespace izlib {
 
@@ -21,15 +26,112 @@ namespace izlib {
   typedef struct iz_path iz_path;
   using iz_path_list = std::vector<iz_path>;
   using iz_node_list = std::vector<int>;
+  class iz_residual_overlay;
+  class iz_ksp_generator;
+
+  // algorithm of a point to point shortest path query. All modes return
+  // the same path, the goal directed ones settle fewer nodes on large
+  // topologies.
+  enum class iz_search_mode {
+    dijkstra,       // one search from the source
+    bidirectional,  // searches from both ends until they meet
+    landmarks       // A* with landmark (ALT) lower bounds
+  };
 
   class iz_topology {
-      std::vector<std::unordered_map<int, iz_edge>> adj_matrix;
-      void update_path_metrics(iz_path& path);
+      // every undirected edge is stored once, with u < v, in parallel
+      // arrays indexed by edge id. A removed edge keeps its id and is
+      // revived in place when it is added again.
+      std::vector<int> edge_u, edge_v;
+      std::vector<int> edge_latency, edge_capacity, edge_residual;
+      std::vector<char> edge_alive;
+      // compressed sparse rows over the u < v direction: row u holds the
+      // targets and ids of the edges of u, sorted by target, in
+      // row_targets/row_edges[row_offsets[u] .. row_offsets[u+1])
+      std::vector<int> row_offsets, row_targets, row_edges;
+      // the same rows over the v > u direction, sorted by source. They
+      // only index the edge ids, so every edge is still stored once.
+      std::vector<int> rev_offsets, rev_sources, rev_edges;
+      // dynamic layer: edges added after the rows were built, indexed
+      // from both ends. They are merged into the rows once they outnumber
+      // the edges in the rows.
+      std::vector<std::vector<int>> new_edges, new_rev_edges;
+      int new_edge_count;
+      // largest latency ever added, sizes the dial buckets
+      int max_latency;
+      // smallest latency ever added, the search is a breadth first search
+      // while it equals max_latency
+      int min_latency;
+      // bumped by every change of an edge or a residual
+      unsigned long long version;
+      // live edges with at least min_capacity residual, indexed from both
+      // ends like the rows. Kept in step with every change of an edge or
+      // a residual, so a search with exactly that min_capacity never
+      // scans the edges below it.
+      struct capacity_view {
+        int min_capacity;
+        // (other end, edge id) of the edges in the view
+        std::vector<std::vector<std::pair<int, int>>> rows;
+        // position of an edge in the rows of its u and v, -1 if the edge
+        // is not in the view
+        std::vector<int> slot_u, slot_v;
+      };
+      std::vector<capacity_view> views;
+      // latencies from every landmark to every node, no_latency_bound for
+      // the nodes a landmark does not reach. Dropped when an edge is
+      // added, since the bounds could then overestimate.
+      std::vector<std::vector<int>> landmark_latencies;
+      // beyond this the buckets would be mostly empty, a heap is used
+      static const int dial_max_latency = 4096;
+
+      void build_rows();
+      int find_edge(int u, int v) const;
+      int live_edge(int u, int v) const;
+      iz_edge make_edge(int id) const;
+      // adds the edge to or removes it from the view if it now belongs
+      // to it or not
+      void update_view(capacity_view& view, int id);
+      void update_views(int id) {
+        for (auto& view : views) update_view(view, id);
+      }
+      const capacity_view* find_view(int min_capacity) const;
+      // calls fn(v, edge id) for every live edge (u, v)
+      template <class edge_fn>
+      void for_each_edge(int u, edge_fn fn) const;
+      // same as for_each_edge, only the edges in view if it is set
+      template <class edge_fn>
+      void for_each_edge(int u, const capacity_view* view, edge_fn fn) const;
+      // shortest path that skips the nodes and edges banned in the
+      // workspace of the thread if use_bans is set. Nodes farther than
+      // latency_bound are not reached; with to_target, the latencies of
+      // all nodes to t, neither are nodes that cannot reach t within the
+      // bound. With t = -1 every reachable node is settled.
+      void search_path(int s, int t, iz_path& path, int min_capacity,
+          const iz_residual_overlay& overlay, bool use_bans,
+          int latency_bound = no_latency_bound,
+          const std::vector<int>* to_target = nullptr) const;
+      // the nodes visited in the search workspace of the thread must have
+      // their exact distance from s and include every node on a shortest
+      // path to t; fills path with the one dijkstra settles
+      void settled_path(int s, int t, int min_capacity, iz_path& path) const;
+      void bidirectional_path(int s, int t, iz_path& path, int min_capacity,
+          int latency_bound) const;
+      // lower bound on the latency from v to t, no_latency_bound if v
+      // cannot reach t
+      int landmark_bound(int v, int t) const;
+      void landmark_path(int s, int t, iz_path& path, int min_capacity,
+          int latency_bound) const;
+      // latency of the shortest path from s to every node, no_latency_bound
+      // for the nodes that cannot be reached
+      void latencies_from(int s, int min_capacity,
+          std::vector<int>& latencies) const;
+      friend class iz_ksp_generator;
     public:
+      static const int no_latency_bound = std::numeric_limits<int>::max();
       int node_count, edge_count;
       explicit iz_topology();
       void init(int node_count);
-      iz_node_list neighbors(int u);
+      iz_node_list neighbors(int u) const;
       iz_edge add_edge(int u, int v, int latency, int capacity);
       iz_edge add_edge(int u, int v, int latency, int capacity, int residual);
       iz_edge_list remove_edge(int u, int v);
@@ -43,10 +145,57 @@ namespace izlib {
       void allocate_bandwidth(int u, int v, int bandwidth);
       void release_bandwidth(int u, int v, int bandwidth);
       int consumed_bandwidth(int u, int v) const;
+      // changes whenever an edge or a residual changes, results computed
+      // at the same version are still valid
+      unsigned long long residual_version() const {return version;}
+      // keeps a view of the edges with at least min_capacity residual.
+      // Searches with that min_capacity and without an overlay only scan
+      // the view. Adding a view that exists does nothing and returns
+      // false. Every view is updated on each change of a residual, views
+      // that are no longer searched should be removed.
+      bool add_capacity_view(int min_capacity);
+      void remove_capacity_view(int min_capacity);
+      // path is left empty if t is farther than latency_bound. The
+      // bidirectional and landmark modes need positive latencies, and the
+      // landmark mode needs build_landmarks, otherwise dijkstra is used.
       void shortest_path(int s, int t, iz_path& path, 
-          int min_capacity = 0);
+          int min_capacity = 0, int latency_bound = no_latency_bound,
+          iz_search_mode mode = iz_search_mode::dijkstra) const;
+      // picks landmark_count landmarks far apart from each other for the
+      // landmark mode, to be called once the edges are added
+      void build_landmarks(int landmark_count);
+      // residuals are read through the overlay
+      void shortest_path(int s, int t, iz_path& path, 
+          int min_capacity, const iz_residual_overlay& overlay) const;
+      // one-to-all search from s: parent and latency of every node on the
+      // shortest path tree, -1 and no_latency_bound for the nodes that
+      // cannot be reached. The tree paths are the ones shortest_path
+      // returns.
+      void shortest_path_tree(int s, int min_capacity,
+          std::vector<int>& parent, std::vector<int>& latencies) const;
+      // yen's algorithm, the topology is only read. Only paths within
+      // latency_bound are returned, spur searches that cannot meet it are
+      // cut short. The spur searches of a round run on pool if one is
+      // given, the result is the same.
       void k_shortest_paths(int s, int t, int K, iz_path_list& k_paths,
-          int min_capacity = 0);
+          int min_capacity = 0, int latency_bound = no_latency_bound,
+          iz_thread_pool* pool = nullptr) const;
+      // pareto front of the simple paths from s to t on the sum of
+      // node_weight over the path nodes and the latency, ordered by
+      // latency: every path has more weight than the shorter ones.
+      // to_target holds lower bounds of the latencies of all nodes to t;
+      // the latencies of shortest_path_tree(t, 0, ..) stay one while no
+      // edge is added, so they can be kept across queries. The front is
+      // approximate: labels are compared per node without the nodes they
+      // visited, which can miss a path that only a dominated label would
+      // have led to, and no label is created once there are max_labels
+      // of them. If that leaves no path to t the front is the shortest
+      // path alone.
+      void pareto_paths(int s, int t, const std::vector<double>& node_weight,
+          const std::vector<int>& to_target, iz_path_list& front,
+          int min_capacity = 0, int latency_bound = no_latency_bound,
+          int max_labels = 1 << 16) const;
+      void update_path_metrics(iz_path& path) const;
   };
 
   struct iz_edge {
@@ -59,6 +208,36 @@ namespace izlib {
         capacity(capacity), residual(residual) {}
     int consumed_bandwidth() const {return capacity - residual;}
   };
+  // residuals changed by a what-if evaluation. Reads fall back to the
+  // topology for the edges the overlay has not changed, the topology
+  // itself is never modified, so any number of overlays can be used
+  // concurrently on the same topology.
+  class iz_residual_overlay {
+      std::unordered_map<long long, int> residuals;
+      static long long key(int u, int v) {
+        if (u > v) std::swap(u, v);
+        return (static_cast<long long>(u) << 32) | v;
+      }
+    public:
+      int residual(const iz_topology& topo, int u, int v) const {
+        auto itr = residuals.find(key(u, v));
+        if (itr == residuals.end()) return topo.residual(u, v);
+        return itr->second;
+      }
+      void allocate_bandwidth(const iz_topology& topo, int u, int v,
+          int bandwidth) {
+        int r = residual(topo, u, v);
+        residuals[key(u, v)] = r - bandwidth;
+      }
+      void release_bandwidth(const iz_topology& topo, int u, int v,
+          int bandwidth) {
+        int r = residual(topo, u, v);
+        residuals[key(u, v)] = r + bandwidth;
+      }
+      bool empty() const {return residuals.empty();}
+      void clear() {residuals.clear();}
+  };
+
   iz_edge_list operator+=(iz_edge_list& lhs, const iz_edge_list& rhs) {
     lhs.reserve(lhs.size() + rhs.size());
     lhs.insert(lhs.end(), rhs.begin(), rhs.end());
@@ -123,26 +302,235 @@ namespace izlib {
     }
   };
 
+  // hash of a node sequence, used to deduplicate yen's candidates
+  struct iz_node_list_hash {
+    size_t operator()(const iz_node_list& nodes) const {
+      size_t h = nodes.size();
+      for (int u : nodes) {
+        h ^= std::hash<int>()(u) + 0x9e3779b9 + (h << 6) + (h >> 2);
+      }
+      return h;
+    }
+  };
+
+  // yen's algorithm one path at a time: next() yields the paths in
+  // order of latency and computes the next one only when it is asked
+  // for. The candidate heap is kept between calls, so pulling k paths
+  // costs the same as k_shortest_paths. The topology must not change
+  // while the generator is in use.
+  class iz_ksp_generator {
+      const iz_topology& topo;
+      int s, t, min_capacity, latency_bound;
+      iz_thread_pool* pool;
+      // latencies of all nodes to t, only used with a latency bound
+      std::vector<int> to_target;
+      iz_path_list k_paths;
+      // heap on the latency
+      iz_path_list candidates;
+      std::unordered_set<iz_node_list, iz_node_list_hash> candidate_set;
+      iz_path_list spur_paths;
+      bool is_started, is_exhausted;
+
+      void spur_search(int i);
+    public:
+      // only paths within latency_bound are generated. The spur searches
+      // of a round run on pool if one is given.
+      iz_ksp_generator(const iz_topology& topo, int s, int t,
+          int min_capacity = 0,
+          int latency_bound = iz_topology::no_latency_bound,
+          iz_thread_pool* pool = nullptr);
+      // false once there are no more paths
+      bool next(iz_path& path);
+      // the i-th shortest path, generating the paths up to it
+      bool path_at(size_t i, iz_path& path);
+      // the paths yielded so far
+      const iz_path_list& paths() const {return k_paths;}
+      // the paths that may be yielded next
+      const iz_path_list& candidate_paths() const {return candidates;}
+  };
+
+  // scratch state of a shortest path search, reused by all searches of a
+  // thread. An entry is valid only if its stamp equals the epoch of the
+  // current search, so nothing has to be cleared between searches.
+  struct iz_search_workspace {
+    std::vector<unsigned> stamp;
+    std::vector<int> dist, capacity, parent;
+    std::vector<char> visited;
+    // dial buckets, indexed by distance modulo the bucket count
+    std::vector<std::vector<int>> buckets;
+    // nodes of the current and the next level of a breadth first search
+    std::vector<int> frontier, next_frontier;
+    // nodes in the order they were settled, kept by the searches that
+    // need it and cleared by them when they start
+    std::vector<int> settled;
+    // queue of the searches that do not use the buckets
+    iz_priority_queue<> heap;
+    unsigned epoch{0};
+    // nodes and edges banned by yen's algorithm, an entry is banned if
+    // its stamp equals ban_epoch
+    std::vector<unsigned> node_ban, edge_ban;
+    unsigned ban_epoch{0};
+
+    void reset(int node_count) {
+      if (stamp.size() < static_cast<size_t>(node_count)) {
+        stamp.resize(node_count, 0);
+        dist.resize(node_count);
+        capacity.resize(node_count);
+        parent.resize(node_count);
+        visited.resize(node_count);
+      }
+      if (++epoch == 0) {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        epoch = 1;
+      }
+    }
+    // first time v is reached in this search
+    void reach(int v) {
+      if (stamp[v] == epoch) return;
+      stamp[v] = epoch;
+      dist[v] = std::numeric_limits<int>::max();
+      capacity[v] = std::numeric_limits<int>::max();
+      parent[v] = -1;
+      visited[v] = false;
+    }
+    bool is_reached(int v) const {return stamp[v] == epoch;}
+
+    // lifts all bans
+    void reset_bans(int node_count, int edge_id_count) {
+      if (node_ban.size() < static_cast<size_t>(node_count)) {
+        node_ban.resize(node_count, 0);
+      }
+      if (edge_ban.size() < static_cast<size_t>(edge_id_count)) {
+        edge_ban.resize(edge_id_count, 0);
+      }
+      if (++ban_epoch == 0) {
+        std::fill(node_ban.begin(), node_ban.end(), 0);
+        std::fill(edge_ban.begin(), edge_ban.end(), 0);
+        ban_epoch = 1;
+      }
+    }
+    void ban_node(int u) {node_ban[u] = ban_epoch;}
+    void ban_edge(int id) {edge_ban[id] = ban_epoch;}
+    bool is_banned(int v, int id) const {
+      return node_ban[v] == ban_epoch || edge_ban[id] == ban_epoch;
+    }
+
+    static iz_search_workspace& local() {
+      thread_local iz_search_workspace workspace;
+      return workspace;
+    }
+    // second workspace of the thread, for the search from the target of
+    // a bidirectional search
+    static iz_search_workspace& local_reverse() {
+      thread_local iz_search_workspace workspace;
+      return workspace;
+    }
+  };
+
+  const int iz_topology::no_latency_bound;
+
   iz_topology::iz_topology() :
+      new_edge_count{0}, max_latency{0},
+      min_latency{std::numeric_limits<int>::max()}, version{0},
       node_count{0}, edge_count {0} {}
 
   void iz_topology::init(int node_count_) {
     node_count = node_count_;
-    adj_matrix.resize(node_count, 
-        std::unordered_map<int, iz_edge> {});
+    new_edges.resize(node_count);
+    new_rev_edges.resize(node_count);
+    for (auto& view : views) view.rows.resize(node_count);
+    build_rows();
   }
 
-  iz_node_list iz_topology::neighbors(int u) {
-    assert(u >= 0 && u < node_count);
-    iz_node_list node_list;
-    for (int i = 0; i < u; ++i) {
-      if (adj_matrix[i].find(u) != adj_matrix[i].end()) {
-        node_list.push_back(i);
+  // counting sort of the edge ids by row node, then by the other end
+  void build_row_index(const std::vector<int>& row_node,
+      const std::vector<int>& col_node, int node_count,
+      std::vector<int>& offsets, std::vector<int>& cols,
+      std::vector<int>& ids) {
+    offsets.assign(node_count + 1, 0);
+    for (int u : row_node) ++offsets[u + 1];
+    for (int u = 0; u < node_count; ++u) offsets[u + 1] += offsets[u];
+    ids.resize(row_node.size());
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    for (size_t id = 0; id < row_node.size(); ++id) {
+      ids[next[row_node[id]]++] = id;
+    }
+    cols.resize(row_node.size());
+    for (int u = 0; u < node_count; ++u) {
+      std::sort(ids.begin() + offsets[u], ids.begin() + offsets[u + 1],
+          [&](int lhs, int rhs) {return col_node[lhs] < col_node[rhs];});
+      for (int i = offsets[u]; i < offsets[u + 1]; ++i) {
+        cols[i] = col_node[ids[i]];
       }
-    } 
-    for (auto& v_edge : adj_matrix[u]) {
-      node_list.push_back(v_edge.first);
     }
+  }
+
+  void iz_topology::build_rows() {
+    build_row_index(edge_u, edge_v, node_count,
+        row_offsets, row_targets, row_edges);
+    build_row_index(edge_v, edge_u, node_count,
+        rev_offsets, rev_sources, rev_edges);
+    for (auto& ids : new_edges) ids.clear();
+    for (auto& ids : new_rev_edges) ids.clear();
+    new_edge_count = 0;
+  }
+
+  // id of the edge (u, v), removed or not, -1 if it was never added
+  int iz_topology::find_edge(int u, int v) const {
+    if (u > v) std::swap(u, v);
+    auto first = row_targets.begin() + row_offsets[u];
+    auto last = row_targets.begin() + row_offsets[u + 1];
+    auto itr = std::lower_bound(first, last, v);
+    if (itr != last && *itr == v) {
+      return row_edges[itr - row_targets.begin()];
+    }
+    for (int id : new_edges[u]) {
+      if (edge_v[id] == v) return id;
+    }
+    return -1;
+  }
+
+  int iz_topology::live_edge(int u, int v) const {
+    int id = find_edge(u, v);
+    return id != -1 && edge_alive[id] ? id : -1;
+  }
+
+  iz_edge iz_topology::make_edge(int id) const {
+    return iz_edge(edge_u[id], edge_v[id], edge_latency[id],
+        edge_capacity[id], edge_residual[id]);
+  }
+
+  // O(degree): the edges to smaller nodes come from the reverse rows
+  template <class edge_fn>
+  void iz_topology::for_each_edge(int u, edge_fn fn) const {
+    for (int i = rev_offsets[u]; i < rev_offsets[u + 1]; ++i) {
+      if (edge_alive[rev_edges[i]]) fn(rev_sources[i], rev_edges[i]);
+    }
+    for (int id : new_rev_edges[u]) {
+      if (edge_alive[id]) fn(edge_u[id], id);
+    }
+    for (int i = row_offsets[u]; i < row_offsets[u + 1]; ++i) {
+      if (edge_alive[row_edges[i]]) fn(row_targets[i], row_edges[i]);
+    }
+    for (int id : new_edges[u]) {
+      if (edge_alive[id]) fn(edge_v[id], id);
+    }
+  }
+
+  template <class edge_fn>
+  void iz_topology::for_each_edge(int u, const capacity_view* view,
+      edge_fn fn) const {
+    if (!view) {
+      for_each_edge(u, fn);
+      return;
+    }
+    for (auto& edge : view->rows[u]) fn(edge.first, edge.second);
+  }
+
+  iz_node_list iz_topology::neighbors(int u) const {
+    assert(u >= 0 && u < node_count);
+    iz_node_list node_list;
+    for_each_edge(u, [&](int v, int id) {node_list.push_back(v);});
     return node_list;
   }
 
@@ -151,12 +539,38 @@ namespace izlib {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
     assert(latency >= 0 && capacity >= 0);
-    //std::tie(u, v) = std::minmax({u,v});
     if (u > v) std::swap(u, v);
-    iz_edge edge(u, v, latency, capacity, residual);
-    adj_matrix[u].insert(std::make_pair(v, edge));
     ++edge_count;
-    return edge;
+    ++version;
+    max_latency = std::max(max_latency, latency);
+    min_latency = std::min(min_latency, latency);
+    landmark_latencies.clear();
+    int id = find_edge(u, v);
+    if (id != -1) {
+      // an existing edge is kept as it is
+      if (!edge_alive[id]) {
+        edge_latency[id] = latency;
+        edge_capacity[id] = capacity;
+        edge_residual[id] = residual;
+        edge_alive[id] = true;
+        update_views(id);
+      }
+      return make_edge(id);
+    }
+    id = edge_u.size();
+    edge_u.push_back(u);
+    edge_v.push_back(v);
+    edge_latency.push_back(latency);
+    edge_capacity.push_back(capacity);
+    edge_residual.push_back(residual);
+    edge_alive.push_back(true);
+    new_edges[u].push_back(id);
+    new_rev_edges[v].push_back(id);
+    update_views(id);
+    if (++new_edge_count > std::max<int>(16, row_edges.size())) {
+      build_rows();
+    }
+    return make_edge(id);
   }
 
 
@@ -169,14 +583,15 @@ namespace izlib {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
     iz_edge_list edge_list;
-    std::tie(u, v) = std::minmax({u,v});
-    auto edge_itr = adj_matrix[u].find(v);
-    if (edge_itr == adj_matrix[u].end()) {
+    int id = live_edge(u, v);
+    if (id == -1) {
       return edge_list;
     }
-    edge_list.push_back(edge_itr->second);
-    adj_matrix[u].erase(v);
+    edge_list.push_back(make_edge(id));
+    edge_alive[id] = false;
+    update_views(id);
     --edge_count;
+    ++version;
     return edge_list;
   }
 
@@ -184,26 +599,38 @@ namespace izlib {
     assert(u >= 0 && u < node_count);
 
     iz_edge_list edge_list;
-    for (int i = 0; i < u; ++i) {
-      if (adj_matrix[i].find(u) != adj_matrix[i].end()) {
-        edge_list.push_back(adj_matrix[i].find(u)->second);
-        adj_matrix[i].erase(u);
-        --edge_count;
-      }
-    }
-    for (auto& v_edge : adj_matrix[u]) {
-      edge_list.push_back(v_edge.second);
+    for_each_edge(u, [&](int v, int id) {
+      edge_list.push_back(make_edge(id));
+    });
+    for (auto& edge : edge_list) {
+      int id = find_edge(edge.u, edge.v);
+      edge_alive[id] = false;
+      update_views(id);
       --edge_count;
+      ++version;
     }
-    adj_matrix[u].clear();
     return edge_list;
   }
 
+  // edges in (u, v) order
   iz_edge_list iz_topology::edges() const {
     iz_edge_list edge_list;
+    edge_list.reserve(edge_u.size());
     for (int u = 0; u < node_count; ++u) {
-      for (auto& v_edge : adj_matrix[u]) {
-        edge_list.push_back(v_edge.second);
+      size_t first = edge_list.size();
+      for (int i = row_offsets[u]; i < row_offsets[u + 1]; ++i) {
+        if (edge_alive[row_edges[i]]) {
+          edge_list.push_back(make_edge(row_edges[i]));
+        }
+      }
+      for (int id : new_edges[u]) {
+        if (edge_alive[id]) edge_list.push_back(make_edge(id));
+      }
+      if (!new_edges[u].empty()) {
+        std::sort(edge_list.begin() + first, edge_list.end(),
+            [](const iz_edge& lhs, const iz_edge& rhs) {
+              return lhs.v < rhs.v;
+            });
       }
     }
     return edge_list;
@@ -211,15 +638,9 @@ namespace izlib {
 
   iz_edge_list iz_topology::edges(int u) const {
     iz_edge_list edge_list;
-    for (int i = 0; i < u; ++i) {
-      auto edge_itr = adj_matrix[i].find(u);
-      if (edge_itr != adj_matrix[i].end()) {
-        edge_list.push_back(edge_itr->second);
-      }
-    }
-    for (auto& v_edge : adj_matrix[u]) {
-      edge_list.push_back(v_edge.second);
-    }
+    for_each_edge(u, [&](int v, int id) {
+      edge_list.push_back(make_edge(id));
+    });
     return edge_list;
   }
     
@@ -227,14 +648,14 @@ namespace izlib {
   iz_edge_list iz_topology::path_edges(const iz_path& path) const {
     iz_edge_list edges;
     if (path.size() == 0) return edges;
-    int u = path.nodes[0], v, _u, _v;
+    int u = path.nodes[0], v;
     assert(u >= 0 && u < node_count);
     for (size_t i = 1; i < path.size(); ++i) {
       v = path.nodes[i];
       assert(v >= 0 && v < node_count);
-      _u = std::min(u, v);
-      _v = std::max(u, v);
-      edges.emplace_back(adj_matrix[_u].find(_v)->second);
+      int id = live_edge(u, v);
+      assert(id != -1);
+      edges.emplace_back(make_edge(id));
       u = v; 
     }
     return edges;
@@ -243,32 +664,29 @@ namespace izlib {
   int iz_topology::latency(int u, int v) const {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
-    //std::tie(u, v) = std::minmax({u,v});
-    if (u > v) std::swap(u, v);
-    auto edge_itr = adj_matrix[u].find(v);
-    if (edge_itr == adj_matrix[u].end()) 
-      return std::numeric_limits<int>::max();
-    return edge_itr->second.latency;
+    int id = live_edge(u, v);
+    if (id == -1) return std::numeric_limits<int>::max();
+    return edge_latency[id];
   }
 
   int iz_topology::residual(int u, int v) const {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
-    std::tie(u, v) = std::minmax({u,v});
-    auto edge_itr = adj_matrix[u].find(v);
-    if (edge_itr == adj_matrix[u].end()) return 0;
-    return edge_itr->second.residual;
+    int id = live_edge(u, v);
+    if (id == -1) return 0;
+    return edge_residual[id];
   }
 
   void iz_topology::set_residual_bandwidth(int u, int v, int bandwidth) {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
     assert(bandwidth >= 0);
-    std::tie(u, v) = std::minmax({u,v});
-    auto edge_itr = adj_matrix[u].find(v);
-    if (edge_itr != adj_matrix[u].end()) {
-      edge_itr->second.capacity = bandwidth;
-      edge_itr->second.residual = bandwidth;
+    int id = live_edge(u, v);
+    if (id != -1) {
+      edge_capacity[id] = bandwidth;
+      edge_residual[id] = bandwidth;
+      update_views(id);
+      ++version;
     }
   }
 
@@ -276,10 +694,11 @@ namespace izlib {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
     assert(bandwidth >= 0);
-    std::tie(u, v) = std::minmax({u,v});
-    auto edge_itr = adj_matrix[u].find(v);
-    if (edge_itr != adj_matrix[u].end()) {
-      edge_itr->second.residual -= bandwidth;
+    int id = live_edge(u, v);
+    if (id != -1) {
+      edge_residual[id] -= bandwidth;
+      update_views(id);
+      ++version;
     }
   }
 
@@ -287,139 +706,706 @@ namespace izlib {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
     assert(bandwidth >= 0);
-    std::tie(u, v) = std::minmax({u,v});
-    auto edge_itr = adj_matrix[u].find(v);
-    if (edge_itr != adj_matrix[u].end()) {
-      edge_itr->second.residual += bandwidth;
+    int id = live_edge(u, v);
+    if (id != -1) {
+      edge_residual[id] += bandwidth;
+      update_views(id);
+      ++version;
+    }
+  }
+
+  void iz_topology::update_view(capacity_view& view, int id) {
+    if (view.slot_u.size() <= static_cast<size_t>(id)) {
+      view.slot_u.resize(edge_u.size(), -1);
+      view.slot_v.resize(edge_u.size(), -1);
+    }
+    bool is_in_view = view.slot_u[id] != -1;
+    if (is_in_view ==
+        (edge_alive[id] && edge_residual[id] >= view.min_capacity)) {
+      return;
+    }
+    int u = edge_u[id], v = edge_v[id];
+    if (!is_in_view) {
+      view.slot_u[id] = view.rows[u].size();
+      view.rows[u].emplace_back(v, id);
+      view.slot_v[id] = view.rows[v].size();
+      view.rows[v].emplace_back(u, id);
+      return;
+    }
+    // the last entry of the row takes the place of the removed one
+    auto remove = [&](int node, int slot) {
+      auto& row = view.rows[node];
+      row[slot] = row.back();
+      row.pop_back();
+      if (slot == static_cast<int>(row.size())) return;
+      int moved = row[slot].second;
+      (edge_u[moved] == node ? view.slot_u : view.slot_v)[moved] = slot;
+    };
+    remove(u, view.slot_u[id]);
+    remove(v, view.slot_v[id]);
+    view.slot_u[id] = view.slot_v[id] = -1;
+  }
+
+  const iz_topology::capacity_view* iz_topology::find_view(
+      int min_capacity) const {
+    for (auto& view : views) {
+      if (view.min_capacity == min_capacity) return &view;
+    }
+    return nullptr;
+  }
+
+  bool iz_topology::add_capacity_view(int min_capacity) {
+    if (find_view(min_capacity)) return false;
+    views.emplace_back();
+    auto& view = views.back();
+    view.min_capacity = min_capacity;
+    view.rows.resize(node_count);
+    view.slot_u.assign(edge_u.size(), -1);
+    view.slot_v.assign(edge_u.size(), -1);
+    for (size_t id = 0; id < edge_u.size(); ++id) update_view(view, id);
+    return true;
+  }
+
+  void iz_topology::remove_capacity_view(int min_capacity) {
+    for (auto itr = views.begin(); itr != views.end(); ++itr) {
+      if (itr->min_capacity == min_capacity) {
+        views.erase(itr);
+        return;
+      }
     }
   }
 
   int iz_topology::consumed_bandwidth(int u, int v) const {
     assert(u >= 0 && u < node_count);
     assert(v >= 0 && v < node_count);
-    std::tie(u, v) = std::minmax({u,v});
-    auto edge_itr = adj_matrix[u].find(v);
-    if (edge_itr == adj_matrix[u].end()) return 0;
-    return edge_itr->second.consumed_bandwidth();
+    int id = live_edge(u, v);
+    if (id == -1) return 0;
+    return edge_capacity[id] - edge_residual[id];
   }
 
   void iz_topology::shortest_path(int s, int t, iz_path& path, 
-      int min_capacity) {
-    std::vector<int> dist(node_count, std::numeric_limits<int>::max());
-    std::vector<int> capacity(node_count, std::numeric_limits<int>::max());
-    std::vector<int> parent(node_count, -1);
-    std::vector<bool> visited(node_count, false);
+      int min_capacity, int latency_bound, iz_search_mode mode) const {
+    // with zero latency edges dijkstra does not settle in (distance, id)
+    // order, which settled_path relies on
+    if (mode == iz_search_mode::bidirectional && min_latency > 0) {
+      bidirectional_path(s, t, path, min_capacity, latency_bound);
+    }
+    else if (mode == iz_search_mode::landmarks && min_latency > 0 &&
+        !landmark_latencies.empty()) {
+      landmark_path(s, t, path, min_capacity, latency_bound);
+    }
+    else {
+      search_path(s, t, path, min_capacity, iz_residual_overlay(), false,
+          latency_bound);
+    }
+  }
 
-    dist[s] = 0;
-    parent[s] = s;
+  // Dijkstra on the integer latencies. Nodes enter the queue only when
+  // they are reached and the search stops once t is settled. Nodes with
+  // the same distance are settled in id order. The queue is a dial
+  // bucket queue unless the latencies are too large for it, then a
+  // binary heap is used instead. If every edge has the same latency, as
+  // in the pod of a co, a breadth first search over a frontier is
+  // enough.
+  void iz_topology::shortest_path(int s, int t, iz_path& path, 
+      int min_capacity, const iz_residual_overlay& overlay) const {
+    search_path(s, t, path, min_capacity, overlay, false);
+  }
 
-    iz_priority_queue<> pq;
-    for (int u = 0; u < node_count; ++u) {
-      pq.push(u, dist[u]);
-    }
+  void iz_topology::search_path(int s, int t, iz_path& path,
+      int min_capacity, const iz_residual_overlay& overlay, bool use_bans,
+      int latency_bound, const std::vector<int>* to_target) const {
+    assert(s >= 0 && s < node_count);
+    assert(t >= -1 && t < node_count);
+    // nodes are not reached if they cannot be on a path within the bound
+    auto is_within_bound = [&](int v, int dist) {
+      if (dist > latency_bound) return false;
+      if (!to_target) return true;
+      int rest = (*to_target)[v];
+      return rest != no_latency_bound && rest <= latency_bound - dist;
+    };
+    path.clear();
+    if (!is_within_bound(s, 0)) return;
+    // residuals come straight from the edge arrays unless the overlay
+    // changed some of them
+    bool use_overlay = !overlay.empty();
+    auto residual = [&](int u, int v, int id) {
+      return use_overlay ? overlay.residual(*this, u, v) : edge_residual[id];
+    };
 
-    bool found_t = false;
-    while (!found_t && !pq.empty()) {
-    //while (!pq.empty()) {
-      int u = pq.top();
-      pq.pop();
-      for (int v : neighbors(u)) {
-        if (visited[v]) continue;
-        if (residual(u, v) < min_capacity) continue;
-        if (parent[u] != -1 && dist[v] > dist[u] + latency(u, v)) {
-          dist[v] = dist[u] + latency(u, v);
-          capacity[v] = std::min(capacity[u], residual(u, v));
-          parent[v] = u;
-          pq.update_key(v, dist[v]);
+    auto& ws = iz_search_workspace::local();
+    ws.reset(node_count);
+    ws.reach(s);
+    ws.dist[s] = 0;
+    ws.parent[s] = s;
+
+    // edges below min_capacity are not scanned if there is a view of it
+    const capacity_view* view =
+        use_overlay ? nullptr : find_view(min_capacity);
+
+    // relaxes the edge (u, v) of the settled node u, true if the
+    // distance of v improved and v has to be queued
+    auto relax = [&](int u, int v, int id) {
+      if (use_bans && ws.is_banned(v, id)) return false;
+      ws.reach(v);
+      if (ws.visited[v]) return false;
+      int r = residual(u, v, id);
+      if (r < min_capacity) return false;
+      int dist = ws.dist[u] + edge_latency[id];
+      if (ws.dist[v] <= dist || !is_within_bound(v, dist)) return false;
+      ws.dist[v] = dist;
+      ws.capacity[v] = std::min(ws.capacity[u], r);
+      ws.parent[v] = u;
+      return true;
+    };
+
+    if (min_latency == max_latency && max_latency > 0) {
+      // all edges have the same latency: levels of a breadth first
+      // search, each settled in id order like the buckets below
+      ws.frontier.assign(1, s);
+      bool found_t = false;
+      while (!ws.frontier.empty() && !found_t) {
+        ws.next_frontier.clear();
+        for (int u : ws.frontier) {
+          ws.visited[u] = true;
+          if (u == t) {
+            found_t = true;
+            break;
+          }
+          for_each_edge(u, view, [&](int v, int id) {
+            if (relax(u, v, id)) ws.next_frontier.push_back(v);
+          });
         }
-        if (v == t) {
-          found_t = true;
-          break;
+        std::sort(ws.next_frontier.begin(), ws.next_frontier.end());
+        ws.frontier.swap(ws.next_frontier);
+      }
+    }
+    else if (max_latency <= dial_max_latency) {
+      // distances in the queue are within max_latency of the one being
+      // settled, so max_latency + 1 circular buckets never collide
+      int bucket_count = max_latency + 1;
+      if (ws.buckets.size() < static_cast<size_t>(bucket_count)) {
+        ws.buckets.resize(bucket_count);
+      }
+      ws.buckets[0].push_back(s);
+      int pending{1};
+      bool found_t = false;
+      for (int d = 0; pending > 0 && !found_t; ++d) {
+        auto& bucket = ws.buckets[d % bucket_count];
+        bool is_sorted = false;
+        auto push = [&](int v) {
+          ws.buckets[ws.dist[v] % bucket_count].push_back(v);
+          ++pending;
+          // zero latency edges add to the bucket being settled
+          if (ws.dist[v] == d) is_sorted = false;
+        };
+        while (!bucket.empty() && !found_t) {
+          // settle the bucket in id order, smallest id at the back
+          if (!is_sorted) {
+            std::sort(bucket.begin(), bucket.end(), std::greater<int>());
+            is_sorted = true;
+          }
+          int u = bucket.back();
+          bucket.pop_back();
+          --pending;
+          // stale entry of a node that got a shorter distance
+          if (ws.visited[u] || ws.dist[u] != d) continue;
+          ws.visited[u] = true;
+          if (u == t) found_t = true;
+          else for_each_edge(u, view, [&](int v, int id) {
+            if (relax(u, v, id)) push(v);
+          });
         }
       }
-      visited[u] = true;
+      for (int i = 0; i < bucket_count; ++i) ws.buckets[i].clear();
+    }
+    else {
+      auto& pq = ws.heap;
+      pq.clear();
+      pq.push(s, 0);
+      auto push = [&](int v) {
+        if (!pq.update_key(v, ws.dist[v])) pq.push(v, ws.dist[v]);
+      };
+      while (!pq.empty()) {
+        int u = pq.top();
+        pq.pop();
+        ws.visited[u] = true;
+        if (u == t) break;
+        for_each_edge(u, view, [&](int v, int id) {
+          if (relax(u, v, id)) push(v);
+        });
+      }
     }
 
-    path.clear();
-    if (parent[t] != -1) {
-      path.latency = dist[t];
-      path.capacity = capacity[t];
+    if (t != -1 && ws.is_reached(t) && ws.parent[t] != -1) {
+      path.latency = ws.dist[t];
+      path.capacity = ws.capacity[t];
       path.nodes.push_back(t);
       int _p = t;
       while (_p != s) {
-        _p = parent[_p];
+        _p = ws.parent[_p];
         path.nodes.push_back(_p);
       }
       std::reverse(path.nodes.begin(), path.nodes.end());
     }
   }
 
-  void iz_topology::k_shortest_paths(int s, int t, int K, 
-      iz_path_list& k_paths, int min_capacity) {
+  // dijkstra settles nodes in (distance, id) order and takes the first
+  // settled neighbor on a shortest path as the parent, so the parent of
+  // a node is its neighbor with the smallest (distance, id) among the
+  // ones it can be reached from on a shortest path
+  void iz_topology::settled_path(int s, int t, int min_capacity,
+      iz_path& path) const {
+    auto& ws = iz_search_workspace::local();
+    path.clear();
+    path.latency = ws.dist[t];
+    path.capacity = std::numeric_limits<int>::max();
+    path.nodes.push_back(t);
+    for (int v = t; v != s;) {
+      int parent{-1}, parent_id{-1};
+      for_each_edge(v, [&](int u, int id) {
+        if (!ws.is_reached(u) || !ws.visited[u]) return;
+        if (edge_residual[id] < min_capacity) return;
+        if (ws.dist[u] + edge_latency[id] != ws.dist[v]) return;
+        if (parent == -1 || ws.dist[u] < ws.dist[parent] ||
+            (ws.dist[u] == ws.dist[parent] && u < parent)) {
+          parent = u;
+          parent_id = id;
+        }
+      });
+      assert(parent != -1);
+      path.capacity = std::min(path.capacity, edge_residual[parent_id]);
+      path.nodes.push_back(parent);
+      v = parent;
+    }
+    std::reverse(path.nodes.begin(), path.nodes.end());
+  }
+
+  // the searches from s and from t advance the side with the smaller
+  // distance until the distances of both queues add up to more than the
+  // shortest latency. Then every node on a shortest path is settled by
+  // one of them. A node settled only from t is on a shortest path if it
+  // can be reached from a node known to be on one, those get their
+  // distance from s before the path is read back.
+  void iz_topology::bidirectional_path(int s, int t, iz_path& path,
+      int min_capacity, int latency_bound) const {
     assert(s >= 0 && s < node_count);
-    assert(t >= 0 && s < node_count);
-    assert(K > 0);
+    assert(t >= 0 && t < node_count);
+    path.clear();
+    auto& fwd = iz_search_workspace::local();
+    auto& bwd = iz_search_workspace::local_reverse();
+    fwd.reset(node_count);
+    bwd.reset(node_count);
+    fwd.reach(s);
+    fwd.dist[s] = 0;
+    bwd.reach(t);
+    bwd.dist[t] = 0;
+    auto& fwd_pq = fwd.heap;
+    auto& bwd_pq = bwd.heap;
+    fwd_pq.clear();
+    bwd_pq.clear();
+    fwd_pq.push(s, 0);
+    bwd_pq.push(t, 0);
+    // nodes settled from t, by distance to t
+    auto& bwd_settled = bwd.settled;
+    bwd_settled.clear();
+    long long best = std::numeric_limits<long long>::max();
+    while (!fwd_pq.empty() && !bwd_pq.empty() &&
+        static_cast<long long>(fwd_pq.top_key()) + bwd_pq.top_key() <=
+            std::min(best, static_cast<long long>(latency_bound))) {
+      bool forward = fwd_pq.top_key() <= bwd_pq.top_key();
+      auto& ws = forward ? fwd : bwd;
+      auto& other = forward ? bwd : fwd;
+      auto& pq = forward ? fwd_pq : bwd_pq;
+      int u = pq.top();
+      pq.pop();
+      ws.visited[u] = true;
+      if (!forward) bwd_settled.push_back(u);
+      for_each_edge(u, [&](int v, int id) {
+        if (edge_residual[id] < min_capacity) return;
+        ws.reach(v);
+        if (ws.visited[v]) return;
+        int dist = ws.dist[u] + edge_latency[id];
+        if (ws.dist[v] > dist) {
+          ws.dist[v] = dist;
+          if (!pq.update_key(v, dist)) pq.push(v, dist);
+        }
+        if (other.is_reached(v) &&
+            other.dist[v] != std::numeric_limits<int>::max()) {
+          best = std::min(best,
+              static_cast<long long>(ws.dist[v]) + other.dist[v]);
+        }
+      });
+      if (u == (forward ? t : s)) {
+        best = std::min(best, static_cast<long long>(ws.dist[u]));
+      }
+    }
+    if (best > latency_bound) return;
+    int latency = best;
+    // distances from s of the nodes settled only from t, nearest to s
+    // first so their predecessors on a shortest path are known
+    for (auto itr = bwd_settled.rbegin(); itr != bwd_settled.rend(); ++itr) {
+      int u = *itr;
+      if (fwd.is_reached(u) && fwd.visited[u]) continue;
+      int dist = latency - bwd.dist[u];
+      bool is_on_path = u == s;
+      for_each_edge(u, [&](int w, int id) {
+        if (is_on_path || edge_residual[id] < min_capacity) return;
+        is_on_path = fwd.is_reached(w) && fwd.visited[w] &&
+            fwd.dist[w] + edge_latency[id] == dist;
+      });
+      if (!is_on_path) continue;
+      fwd.reach(u);
+      fwd.dist[u] = dist;
+      fwd.visited[u] = true;
+    }
+    settled_path(s, t, min_capacity, path);
+  }
 
-    k_paths.clear();
+  int iz_topology::landmark_bound(int v, int t) const {
+    int bound{0};
+    for (auto& latencies : landmark_latencies) {
+      bool reaches_v = latencies[v] != no_latency_bound;
+      bool reaches_t = latencies[t] != no_latency_bound;
+      if (reaches_v != reaches_t) return no_latency_bound;
+      if (reaches_v) {
+        bound = std::max(bound, std::abs(latencies[t] - latencies[v]));
+      }
+    }
+    return bound;
+  }
 
-    iz_path s_path;
-    shortest_path(s, t, s_path, min_capacity);
-    if (!s_path.is_valid()) return;
-    k_paths.push_back(s_path);
-      
-    //std::priority_queue<iz_path> pq;
-    std::set<std::vector<int>> pq_set;
-    std::priority_queue<iz_path, std::vector<iz_path>, 
-        std::greater<iz_path>> pq;
-   
-    for (int k = 1; k < K; ++k) {
-      for (size_t i = 0; i < k_paths[k-1].size()-1; ++i) {
-        int spur_node = k_paths[k-1].nodes[i];
-        iz_path root_path;
-        root_path.clear();
-        root_path.nodes.insert(root_path.nodes.end(), 
-            k_paths[k-1].nodes.begin(), k_paths[k-1].nodes.begin()+i+1);
-
-        iz_edge_list removed_edges;
-
-        for (auto& path : k_paths) {
-          if (root_path.is_equal_upto(path, i)) {
-            removed_edges += remove_edge(path.nodes[i], 
-                path.nodes[i+1]);
-          }
+  // A* on the latencies plus the landmark bound to t. The bounds are
+  // consistent, and links below min_capacity can only make paths
+  // longer, so settled nodes have their exact distance. The search goes
+  // on until every node that can be on a shortest path is settled.
+  void iz_topology::landmark_path(int s, int t, iz_path& path,
+      int min_capacity, int latency_bound) const {
+    assert(s >= 0 && s < node_count);
+    assert(t >= 0 && t < node_count);
+    path.clear();
+    int s_bound = landmark_bound(s, t);
+    if (s_bound == no_latency_bound || s_bound > latency_bound) return;
+    auto& ws = iz_search_workspace::local();
+    ws.reset(node_count);
+    ws.reach(s);
+    ws.dist[s] = 0;
+    auto& pq = ws.heap;
+    pq.clear();
+    pq.push(s, s_bound);
+    int limit = latency_bound;
+    bool found_t = false;
+    while (!pq.empty() && pq.top_key() <= limit) {
+      int u = pq.top();
+      pq.pop();
+      ws.visited[u] = true;
+      if (u == t) {
+        found_t = true;
+        limit = ws.dist[t];
+      }
+      for_each_edge(u, [&](int v, int id) {
+        if (edge_residual[id] < min_capacity) return;
+        ws.reach(v);
+        if (ws.visited[v]) return;
+        int dist = ws.dist[u] + edge_latency[id];
+        if (ws.dist[v] <= dist) return;
+        int bound = landmark_bound(v, t);
+        if (bound == no_latency_bound ||
+            static_cast<long long>(dist) + bound > limit) {
+          return;
         }
+        ws.dist[v] = dist;
+        if (!pq.update_key(v, dist + bound)) pq.push(v, dist + bound);
+      });
+    }
+    if (found_t) settled_path(s, t, min_capacity, path);
+  }
 
-        for (int u : root_path.nodes) {
-          if (u != spur_node) {
-            removed_edges += remove_node(u);
-          }
+  void iz_topology::build_landmarks(int landmark_count) {
+    landmark_latencies.clear();
+    if (node_count == 0) return;
+    // the next landmark is the node farthest from the ones picked so
+    // far, starting from the node farthest from node 0
+    std::vector<int> nearest(node_count, no_latency_bound);
+    std::vector<int> latencies;
+    latencies_from(0, 0, latencies);
+    int landmark = 0;
+    for (int v = 0; v < node_count; ++v) {
+      if (latencies[v] != no_latency_bound &&
+          latencies[v] > latencies[landmark]) {
+        landmark = v;
+      }
+    }
+    while (static_cast<int>(landmark_latencies.size()) < landmark_count) {
+      latencies_from(landmark, 0, latencies);
+      landmark_latencies.push_back(latencies);
+      int next{-1};
+      for (int v = 0; v < node_count; ++v) {
+        if (latencies[v] != no_latency_bound) {
+          nearest[v] = std::min(nearest[v], latencies[v]);
         }
-
-        s_path.clear();
-        shortest_path(spur_node, t, s_path, min_capacity);
-        for (auto& edge : removed_edges) {
-          add_edge(edge.u, edge.v, edge.latency, edge.capacity, edge.residual);
+        if (nearest[v] != no_latency_bound && nearest[v] > 0 &&
+            (next == -1 || nearest[v] > nearest[next])) {
+          next = v;
         }
+      }
+      if (next == -1) break;
+      landmark = next;
+    }
+  }
 
-        if (!s_path.is_valid()) continue;
-        iz_path total_path = root_path + s_path;
-        update_path_metrics(total_path);
+  void iz_topology::latencies_from(int s, int min_capacity,
+      std::vector<int>& latencies) const {
+    iz_path path;
+    search_path(s, -1, path, min_capacity, iz_residual_overlay(), false);
+    auto& ws = iz_search_workspace::local();
+    latencies.assign(node_count, no_latency_bound);
+    for (int v = 0; v < node_count; ++v) {
+      if (ws.is_reached(v) && ws.visited[v]) latencies[v] = ws.dist[v];
+    }
+  }
 
-        if (pq_set.count(total_path.nodes) == 0) {
-          pq.push(total_path);
-          pq_set.insert(total_path.nodes);
-        }
+  void iz_topology::shortest_path_tree(int s, int min_capacity,
+      std::vector<int>& parent, std::vector<int>& latencies) const {
+    iz_path path;
+    search_path(s, -1, path, min_capacity, iz_residual_overlay(), false);
+    auto& ws = iz_search_workspace::local();
+    parent.assign(node_count, -1);
+    latencies.assign(node_count, no_latency_bound);
+    for (int v = 0; v < node_count; ++v) {
+      if (ws.is_reached(v) && ws.visited[v]) {
+        parent[v] = ws.parent[v];
+        latencies[v] = ws.dist[v];
       }
-      if (pq.empty()) break;
-      iz_path kth_path = pq.top();
-      k_paths.push_back(kth_path);
+    }
+  }
+
+  void iz_topology::k_shortest_paths(int s, int t, int K, 
+      iz_path_list& k_paths, int min_capacity, int latency_bound,
+      iz_thread_pool* pool) const {
+    assert(K > 0);
+    k_paths.clear();
+    iz_ksp_generator ksp(*this, s, t, min_capacity, latency_bound, pool);
+    iz_path path;
+    while (k_paths.size() < static_cast<size_t>(K) && ksp.next(path)) {
+      k_paths.push_back(std::move(path));
+    }
+  }
+
+  // label setting in order of latency. A label is a path ending at its
+  // node; it is dropped if another label of the node is not longer and
+  // has at least its weight, so a node keeps at most one label per
+  // latency. Labels only extend to nodes they have not visited and that
+  // can still reach t within the latency bound. Every label keeps a
+  // bitset of its visited nodes, max_labels bounds the memory to
+  // max_labels * node_count bits.
+  void iz_topology::pareto_paths(int s, int t,
+      const std::vector<double>& node_weight,
+      const std::vector<int>& to_target, iz_path_list& front,
+      int min_capacity, int latency_bound, int max_labels) const {
+    assert(s >= 0 && s < node_count);
+    assert(t >= 0 && t < node_count);
+    assert(node_weight.size() >= static_cast<size_t>(node_count));
+    assert(to_target.size() >= static_cast<size_t>(node_count));
+    front.clear();
+
+    auto is_within_bound = [&](int v, int latency) {
+      return latency <= latency_bound && to_target[v] != no_latency_bound &&
+          to_target[v] <= latency_bound - latency;
+    };
+    if (!is_within_bound(s, 0)) return;
+
+    struct label {
+      int node, parent;
+      int latency, capacity;
+      double weight;
+      bool is_alive;
+    };
+    std::vector<label> labels;
+    // visited nodes of label id, a bitset in visited[id * words ..]
+    const int words = (node_count + 63) / 64;
+    std::vector<uint64_t> visited;
+    auto is_visited = [&](int id, int v) {
+      return (visited[id * words + v / 64] >> (v % 64)) & 1;
+    };
+    std::vector<std::vector<int>> node_labels(node_count);
+    // (latency, label id)
+    std::priority_queue<std::pair<int, int>,
+        std::vector<std::pair<int, int>>,
+        std::greater<std::pair<int, int>>> pq;
+    labels.push_back({s, -1, 0, std::numeric_limits<int>::max(),
+        node_weight[s], true});
+    visited.assign(words, 0);
+    visited[s / 64] |= uint64_t(1) << (s % 64);
+    node_labels[s].push_back(0);
+    pq.push({0, 0});
+
+    while (!pq.empty()) {
+      int id = pq.top().second;
       pq.pop();
-      pq_set.erase(kth_path.nodes);
+      if (!labels[id].is_alive || labels[id].node == t) continue;
+      for_each_edge(labels[id].node, [&](int v, int e) {
+        if (edge_residual[e] < min_capacity) return;
+        int latency = labels[id].latency + edge_latency[e];
+        if (!is_within_bound(v, latency) || is_visited(id, v)) return;
+        double weight = labels[id].weight + node_weight[v];
+        auto& at_v = node_labels[v];
+        for (int other : at_v) {
+          if (labels[other].latency <= latency &&
+              labels[other].weight >= weight) return;
+        }
+        if (static_cast<int>(labels.size()) >= max_labels) return;
+        size_t kept{0};
+        for (int other : at_v) {
+          if (latency <= labels[other].latency &&
+              weight >= labels[other].weight) {
+            labels[other].is_alive = false;
+          }
+          else {
+            at_v[kept++] = other;
+          }
+        }
+        at_v.resize(kept);
+        int new_id = labels.size();
+        int capacity = std::min(labels[id].capacity, edge_residual[e]);
+        labels.push_back({v, id, latency, capacity, weight, true});
+        for (int w = 0; w < words; ++w) {
+          uint64_t word = visited[id * words + w];
+          visited.push_back(word);
+        }
+        visited[new_id * words + v / 64] |= uint64_t(1) << (v % 64);
+        at_v.push_back(new_id);
+        pq.push({latency, new_id});
+      });
+    }
+
+    auto& at_t = node_labels[t];
+    if (at_t.empty()) {
+      iz_path path;
+      search_path(s, t, path, min_capacity, iz_residual_overlay(), false,
+          latency_bound, &to_target);
+      if (path.is_valid()) front.push_back(std::move(path));
+      return;
+    }
+    std::sort(at_t.begin(), at_t.end(), [&](int lhs, int rhs) {
+      return labels[lhs].latency < labels[rhs].latency;
+    });
+    for (int id : at_t) {
+      iz_path path(labels[id].latency, labels[id].capacity);
+      for (int l = id; l != -1; l = labels[l].parent) {
+        path.nodes.push_back(labels[l].node);
+      }
+      std::reverse(path.nodes.begin(), path.nodes.end());
+      front.push_back(std::move(path));
+    }
+  }
+
+  iz_ksp_generator::iz_ksp_generator(const iz_topology& topo, int s, int t,
+      int min_capacity, int latency_bound, iz_thread_pool* pool) :
+      topo(topo), s(s), t(t), min_capacity(min_capacity),
+      latency_bound(latency_bound), pool(pool),
+      is_started{false}, is_exhausted{false} {
+    assert(s >= 0 && s < topo.node_count);
+    assert(t >= 0 && t < topo.node_count);
+  }
+
+  // root path + shortest spur path of the i-th node of the last path. The
+  // root path nodes and the next edges of the known paths with the same
+  // root are banned in the workspace of the thread instead of removed.
+  void iz_ksp_generator::spur_search(int i) {
+    const auto& last_path = k_paths.back();
+    int spur_node = last_path.nodes[i];
+    auto& ws = iz_search_workspace::local();
+    ws.reset_bans(topo.node_count, topo.edge_u.size());
+    for (auto& path : k_paths) {
+      if (path.size() <= static_cast<size_t>(i) ||
+          !std::equal(last_path.nodes.begin(),
+              last_path.nodes.begin() + i + 1, path.nodes.begin())) {
+        continue;
+      }
+      int id = topo.live_edge(path.nodes[i], path.nodes[i+1]);
+      if (id != -1) ws.ban_edge(id);
+    }
+    // the spur path has to fit in what the root path left of the bound
+    int budget = latency_bound;
+    const std::vector<int>* bound_to_target = nullptr;
+    if (latency_bound != iz_topology::no_latency_bound) {
+      for (int j = 0; j < i; ++j) {
+        budget -= topo.latency(last_path.nodes[j], last_path.nodes[j+1]);
+      }
+      bound_to_target = &to_target;
+    }
+    for (int j = 0; j < i; ++j) ws.ban_node(last_path.nodes[j]);
+
+    auto& total_path = spur_paths[i];
+    iz_path spur_path;
+    topo.search_path(spur_node, t, spur_path, min_capacity,
+        iz_residual_overlay(), true, budget, bound_to_target);
+    if (!spur_path.is_valid()) return;
+    total_path.nodes.assign(last_path.nodes.begin(),
+        last_path.nodes.begin() + i);
+    total_path.nodes.insert(total_path.nodes.end(),
+        spur_path.nodes.begin(), spur_path.nodes.end());
+    topo.update_path_metrics(total_path);
+  }
+
+  bool iz_ksp_generator::path_at(size_t i, iz_path& path) {
+    while (k_paths.size() <= i) {
+      if (!next(path)) return false;
+    }
+    path = k_paths[i];
+    return true;
+  }
+
+  // the spur paths of a round are merged into the candidates in spur
+  // order, so running them on a pool does not change the result
+  bool iz_ksp_generator::next(iz_path& path) {
+    if (is_exhausted) return false;
+    if (!is_started) {
+      is_started = true;
+      // the latencies to t are lower bounds for every spur search, a
+      // query that cannot meet the bound ends here
+      const std::vector<int>* bound_to_target = nullptr;
+      if (latency_bound != iz_topology::no_latency_bound) {
+        topo.latencies_from(t, min_capacity, to_target);
+        bound_to_target = &to_target;
+      }
+      topo.search_path(s, t, path, min_capacity, iz_residual_overlay(),
+          false, latency_bound, bound_to_target);
+      if (!path.is_valid()) {
+        is_exhausted = true;
+        return false;
+      }
+      k_paths.push_back(path);
+      return true;
+    }
+
+    int spur_count = k_paths.back().size() - 1;
+    spur_paths.assign(spur_count, iz_path());
+    auto spur_fn = [this](int i) {spur_search(i);};
+    if (pool) pool->parallel_for(spur_count, spur_fn);
+    else for (int i = 0; i < spur_count; ++i) spur_fn(i);
+
+    std::greater<iz_path> later;
+    for (auto& total_path : spur_paths) {
+      if (!total_path.is_valid()) continue;
+      if (candidate_set.insert(total_path.nodes).second) {
+        candidates.push_back(std::move(total_path));
+        std::push_heap(candidates.begin(), candidates.end(), later);
+      }
+    }
+    if (candidates.empty()) {
+      is_exhausted = true;
+      return false;
     }
-  
+    std::pop_heap(candidates.begin(), candidates.end(), later);
+    k_paths.push_back(std::move(candidates.back()));
+    candidates.pop_back();
+    path = k_paths.back();
+    return true;
   }
 
-  void iz_topology::update_path_metrics(iz_path& path) {
+  void iz_topology::update_path_metrics(iz_path& path) const {
     path.latency = 0;
     path.capacity = std::numeric_limits<int>::max();
     if (path.size() == 0) return;
@@ -0,0 +1,394 @@
+#ifndef PATHS_FILE_HPP
+#define PATHS_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <utility>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+//=========binary paths file=========//
+// init_topology.dat and paths.dat in the form data_store uses them,
+// written by process_topology.o as paths.bin and mapped as is, so loading
+// it does no parsing. Arrays are 8 byte aligned and in the byte order of
+// the writer. A csr section is an offsets array with one entry more than
+// rows and a values array, row i is values[offsets[i] .. offsets[i+1]).
+// Edges are referred to by their index in the edge table, path i is the
+// i-th path of paths.dat.
+
+constexpr char paths_file_magic[8] = {'E', 'S', 'S', 'O', 'P', 'T', 'H', 'S'};
+// bumped whenever the layout changes
+constexpr uint32_t paths_file_version = 1;
+constexpr uint32_t paths_file_byte_order = 0x01020304;
+
+struct paths_file_csr {
+  uint64_t offsets, values; // byte offsets from the start of the file
+  uint64_t value_count;
+};
+
+struct paths_file_header {
+  char magic[8];
+  uint32_t version, byte_order;
+  int32_t node_count, edge_count, path_count, reserved;
+  uint64_t nodes, edges;          // byte offsets of the two tables
+  paths_file_csr path_nodes;      // path -> nodes, in path order
+  paths_file_csr path_edges;      // path -> edges, self loops skipped
+  paths_file_csr path_switches;   // path -> switches
+  paths_file_csr edge_paths;      // edge -> paths
+  paths_file_csr switch_paths;    // node -> paths, servers have none
+};
+
+struct paths_file_node {
+  int32_t node_id, co_id;
+  char node_category, pad[3];
+  int32_t cpu_capacity;
+  double sleep_power, base_power, per_cpu_power;
+};
+
+struct paths_file_edge {
+  int32_t id, u, v;
+  char type, pad[3];
+  int32_t co_id, capacity, latency;
+};
+
+static_assert(sizeof(paths_file_node) == 40, "paths_file_node is padded");
+static_assert(sizeof(paths_file_edge) == 28, "paths_file_edge is padded");
+
+// rows of a csr section, either built in memory or pointing into a
+// mapped file
+class int_rows {
+    vector<int32_t> owned_offsets, owned_values;
+    const int32_t* offsets{nullptr};
+    const int32_t* values{nullptr};
+    int row_count{0};
+  public:
+    struct row {
+      const int32_t *first, *last;
+      const int32_t* begin() const {return first;}
+      const int32_t* end() const {return last;}
+      size_t size() const {return last - first;}
+      bool empty() const {return first == last;}
+      int32_t front() const {return *first;}
+      int32_t back() const {return *(last - 1);}
+      int32_t operator[](size_t i) const {return first[i];}
+    };
+
+    int_rows() {}
+    // rows may point into owned arrays, a copy would not
+    int_rows(const int_rows&) = delete;
+    int_rows& operator=(const int_rows&) = delete;
+
+    int size() const {return row_count;}
+    row operator[](int i) const {
+      return row{values + offsets[i], values + offsets[i + 1]};
+    }
+    void assign(vector<int32_t>&& row_offsets, vector<int32_t>&& row_values) {
+      owned_offsets = move(row_offsets);
+      owned_values = move(row_values);
+      offsets = owned_offsets.data();
+      values = owned_values.data();
+      row_count = owned_offsets.size() - 1;
+    }
+    void map(const int32_t* row_offsets, const int32_t* row_values,
+        int rows) {
+      owned_offsets.clear();
+      owned_values.clear();
+      offsets = row_offsets;
+      values = row_values;
+      row_count = rows;
+    }
+    // rows[v] lists, in order, the rows of this that contain v
+    void invert(int target_count, int_rows& rows) const {
+      vector<int32_t> inv_offsets(target_count + 1, 0), inv_values;
+      for (int i = 0; i < row_count; ++i) {
+        for (auto v : (*this)[i]) ++inv_offsets[v + 1];
+      }
+      for (int v = 0; v < target_count; ++v) {
+        inv_offsets[v + 1] += inv_offsets[v];
+      }
+      inv_values.resize(inv_offsets.back());
+      vector<int32_t> next(inv_offsets.begin(), inv_offsets.end() - 1);
+      for (int i = 0; i < row_count; ++i) {
+        for (auto v : (*this)[i]) inv_values[next[v]++] = i;
+      }
+      rows.assign(move(inv_offsets), move(inv_values));
+    }
+};
+
+// read only mapping of a whole file
+class mapped_file {
+    void* bytes{MAP_FAILED};
+    size_t byte_count{0};
+  public:
+    mapped_file() {}
+    ~mapped_file() {close();}
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool open(const string& filename) {
+      close();
+      int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd == -1) return false;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        byte_count = st.st_size;
+        bytes = mmap(nullptr, byte_count, PROT_READ, MAP_SHARED, fd, 0);
+      }
+      ::close(fd);
+      if (bytes == MAP_FAILED) byte_count = 0;
+      return is_open();
+    }
+    void close() {
+      if (is_open()) munmap(bytes, byte_count);
+      bytes = MAP_FAILED;
+      byte_count = 0;
+    }
+    bool is_open() const {return bytes != MAP_FAILED;}
+    const char* data() const {return static_cast<const char*>(bytes);}
+    size_t size() const {return byte_count;}
+};
+
+bool is_paths_file(const string& filename) {
+  ifstream fin(filename, ios::binary);
+  char magic[sizeof(paths_file_magic)];
+  return fin.read(magic, sizeof(magic)) &&
+      memcmp(magic, paths_file_magic, sizeof(magic)) == 0;
+}
+
+// writes paths.bin from init_topology.dat and paths.dat. paths.dat is
+// read twice, once to size the sections and once to fill them, and the
+// output is written through a mapping, so only the per node and per
+// edge counters are kept in memory.
+bool write_paths_file(const string& topology_filename,
+    const string& paths_filename, const string& out_filename) {
+  ifstream topo_in(topology_filename);
+  if (!topo_in) {
+    cerr << "failed to open " << topology_filename << endl;
+    return false;
+  }
+  // skip the co lines
+  int co_count;
+  topo_in >> co_count;
+  for (int i = 0; i <= co_count; ++i) {
+    topo_in.ignore(numeric_limits<streamsize>::max(), '\n');
+  }
+  int node_count, edge_count;
+  topo_in >> node_count >> edge_count;
+  vector<paths_file_node> nodes(node_count);
+  for (auto& node : nodes) {
+    node = paths_file_node();
+    topo_in >> node.node_id >> node.node_category >> node.co_id >>
+        node.sleep_power >> node.base_power;
+    if (node.node_category == 'c') {
+      topo_in >> node.cpu_capacity >> node.per_cpu_power;
+    }
+  }
+  vector<paths_file_edge> edges(edge_count);
+  for (auto& edge : edges) {
+    edge = paths_file_edge();
+    topo_in >> edge.id >> edge.u >> edge.v >> edge.type >> edge.co_id >>
+        edge.capacity >> edge.latency;
+  }
+  if (!topo_in) {
+    cerr << "failed to parse " << topology_filename << endl;
+    return false;
+  }
+  // edges of each node, for the (u, v) -> edge lookups
+  vector<int32_t> out_offsets(node_count + 1, 0), out_edges(edge_count);
+  for (auto& edge : edges) ++out_offsets[edge.u + 1];
+  for (int u = 0; u < node_count; ++u) out_offsets[u + 1] += out_offsets[u];
+  {
+    vector<int32_t> next(out_offsets.begin(), out_offsets.end() - 1);
+    for (int i = 0; i < edge_count; ++i) out_edges[next[edges[i].u]++] = i;
+  }
+  auto edge_index = [&](int u, int v) {
+    for (int i = out_offsets[u]; i < out_offsets[u + 1]; ++i) {
+      if (edges[out_edges[i]].v == v) return out_edges[i];
+    }
+    return -1;
+  };
+
+  // calls fn() with the nodes and switches of every path of paths.dat,
+  // fails on negative counts and on nodes that are not in the topology
+  vector<int32_t> path, switches;
+  auto is_node = [&](int32_t u) {return u >= 0 && u < node_count;};
+  auto read_nodes = [&](ifstream& fin, vector<int32_t>& list) {
+    int n{-1};
+    fin >> n;
+    if (n < 0) fin.setstate(ios::failbit);
+    if (!fin) return;
+    list.resize(n);
+    for (auto& u : list) {
+      fin >> u;
+      if (!is_node(u)) fin.setstate(ios::failbit);
+      if (!fin) return;
+    }
+  };
+  auto for_each_path = [&](int& count, function<void()> fn) {
+    ifstream fin(paths_filename);
+    count = -1;
+    fin >> count;
+    if (count < 0) return false;
+    int id;
+    for (int i = 0; i < count && fin; ++i) {
+      fin >> id;
+      read_nodes(fin, path);
+      read_nodes(fin, switches);
+      if (fin) fn();
+    }
+    return static_cast<bool>(fin);
+  };
+
+  // first pass, sizes of the sections
+  int path_count{0};
+  uint64_t node_total{0}, edge_total{0}, switch_total{0};
+  vector<int32_t> edge_offsets(edge_count + 1, 0);
+  vector<int32_t> switch_offsets(node_count + 1, 0);
+  bool parsed = for_each_path(path_count, [&] {
+    node_total += path.size();
+    for (size_t j = 1; j < path.size(); ++j) {
+      int e = edge_index(path[j - 1], path[j]);
+      if (e == -1) continue;
+      ++edge_total;
+      ++edge_offsets[e + 1];
+    }
+    switch_total += switches.size();
+    for (auto s : switches) ++switch_offsets[s + 1];
+  });
+  if (!parsed) {
+    cerr << "failed to parse " << paths_filename << endl;
+    return false;
+  }
+  for (int e = 0; e < edge_count; ++e) edge_offsets[e + 1] += edge_offsets[e];
+  for (int u = 0; u < node_count; ++u) {
+    switch_offsets[u + 1] += switch_offsets[u];
+  }
+
+  // layout
+  paths_file_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, paths_file_magic, sizeof(header.magic));
+  header.version = paths_file_version;
+  header.byte_order = paths_file_byte_order;
+  header.node_count = node_count;
+  header.edge_count = edge_count;
+  header.path_count = path_count;
+  uint64_t size = sizeof(header);
+  auto place = [&size](uint64_t bytes) {
+    size = (size + 7) / 8 * 8;
+    uint64_t offset = size;
+    size += bytes;
+    return offset;
+  };
+  auto place_csr = [&](paths_file_csr& csr, int rows, uint64_t count) {
+    csr.offsets = place((rows + 1) * sizeof(int32_t));
+    csr.values = place(count * sizeof(int32_t));
+    csr.value_count = count;
+  };
+  header.nodes = place(node_count * sizeof(paths_file_node));
+  header.edges = place(edge_count * sizeof(paths_file_edge));
+  place_csr(header.path_nodes, path_count, node_total);
+  place_csr(header.path_edges, path_count, edge_total);
+  place_csr(header.path_switches, path_count, switch_total);
+  place_csr(header.edge_paths, edge_count, edge_total);
+  place_csr(header.switch_paths, node_count, switch_total);
+
+  int fd = open(out_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    cerr << "failed to create " << out_filename << endl;
+    return false;
+  }
+  void* bytes = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    bytes = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (bytes == MAP_FAILED) {
+    cerr << "failed to map " << out_filename << endl;
+    return false;
+  }
+  char* base = static_cast<char*>(bytes);
+  auto array_at = [base](uint64_t offset) {
+    return reinterpret_cast<int32_t*>(base + offset);
+  };
+  memcpy(base, &header, sizeof(header));
+  memcpy(base + header.nodes, nodes.data(),
+      node_count * sizeof(paths_file_node));
+  memcpy(base + header.edges, edges.data(),
+      edge_count * sizeof(paths_file_edge));
+  memcpy(array_at(header.edge_paths.offsets), edge_offsets.data(),
+      edge_offsets.size() * sizeof(int32_t));
+  memcpy(array_at(header.switch_paths.offsets), switch_offsets.data(),
+      switch_offsets.size() * sizeof(int32_t));
+
+  // second pass, the values. The path rows are appended, the paths of an
+  // edge or switch go to the next free slot of its row. If paths.dat
+  // changed since the first pass a row can outgrow its section, then
+  // nothing more is written and the file is rejected.
+  int32_t* csr_offsets[3] = {array_at(header.path_nodes.offsets),
+      array_at(header.path_edges.offsets),
+      array_at(header.path_switches.offsets)};
+  int32_t* csr_values[3] = {array_at(header.path_nodes.values),
+      array_at(header.path_edges.values),
+      array_at(header.path_switches.values)};
+  int32_t* edge_paths = array_at(header.edge_paths.values);
+  int32_t* switch_paths = array_at(header.switch_paths.values);
+  vector<int32_t> edge_next(edge_offsets.begin(), edge_offsets.end() - 1);
+  vector<int32_t> switch_next(switch_offsets.begin(),
+      switch_offsets.end() - 1);
+  uint64_t counts[3] = {0, 0, 0};
+  int i{0}, second_count;
+  bool fits = true;
+  parsed = for_each_path(second_count, [&] {
+    if (second_count != path_count ||
+        counts[0] + path.size() > node_total) {
+      fits = false;
+    }
+    if (!fits) return;
+    for (int c = 0; c < 3; ++c) csr_offsets[c][i] = counts[c];
+    for (size_t j = 0; j < path.size(); ++j) {
+      csr_values[0][counts[0]++] = path[j];
+      if (j == 0) continue;
+      int e = edge_index(path[j - 1], path[j]);
+      if (e == -1) continue;
+      if (edge_next[e] == edge_offsets[e + 1]) {
+        fits = false;
+        return;
+      }
+      csr_values[1][counts[1]++] = e;
+      edge_paths[edge_next[e]++] = i;
+    }
+    for (auto s : switches) {
+      if (switch_next[s] == switch_offsets[s + 1]) {
+        fits = false;
+        return;
+      }
+      csr_values[2][counts[2]++] = s;
+      switch_paths[switch_next[s]++] = i;
+    }
+    ++i;
+  });
+  fits = fits && counts[0] == node_total && counts[1] == edge_total &&
+      counts[2] == switch_total;
+  for (int c = 0; c < 3; ++c) csr_offsets[c][path_count] = counts[c];
+  bool synced = msync(bytes, size, MS_SYNC) == 0;
+  munmap(bytes, size);
+  if (!parsed || !fits || !synced) {
+    unlink(out_filename.c_str());
+    cerr << "failed to write " << out_filename << endl;
+    return false;
+  }
+  return true;
+}
+
+#endif
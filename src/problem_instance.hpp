@@ -2,6 +2,7 @@
 #define PROBLEM_INSTANCE_HPP
 
 #include <map>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <cassert>
@@ -141,38 +142,54 @@ struct problem_instance {
       // create edges
       topology.add_edge(u, v , latency, capacity);
     }
+    topology.build_latency_index();
     fin.close();
     fgc.close();
     return true;
   }
 
-/*  bool read_time_slot_file(const string& filename) {
+  // the sfc ids in the timeslot file are global across timeslots and
+  // the vnfs are given as flavor ids, read_vnf_info_file must be called
+  // first to convert them to cpu requirements
+  bool read_time_slot_file(const string& filename) {
     fstream fin(filename.c_str());
     if (!fin) {
       cout << "ERROR: failed to open timeslot file" << endl;
       return false;
     }
-    int time_slot_count{0};
-    fin >> time_slot_count;
+    int sfc_count{0}, time_slot_count{0};
+    fin >> sfc_count >> time_slot_count;
     for (int t = 0; t < time_slot_count; ++t) {
       sfc_request_set sfc_req_set;
       int sfc_request_count{0};
       fin >> sfc_request_count;
       for (int r = 0; r < sfc_request_count; ++r) {
         sfc_request sfc_req;
-        fin >> sfc_req.ingress_co >> sfc_req.egress_co >> sfc_req.ttl >> 
-            sfc_req.vnf_count;
+        fin >> sfc_req.id >> sfc_req.ingress_co >> sfc_req.egress_co >> 
+            sfc_req.ttl >> sfc_req.vnf_count;
         for (int v = 0; v < sfc_req.vnf_count; ++v) {
-          int vnf_flavor{0};
-          fin >> vnf_flavor;
-          sfc_req.vnf_flavors.push_back(vnf_flavor);
-          sfc_req.cpu_reqs.push_back(vnf_flavors[vnf_flavor].cpu_cores);
+          int flavor_id{0};
+          fin >> flavor_id;
+          auto flavor_itr = find_if(vnf_flavors.begin(), vnf_flavors.end(),
+              [flavor_id](const vnf_flavor& f) {
+                return f.flavor_id == flavor_id;
+              });
+          if (flavor_itr == vnf_flavors.end()) {
+            cout << "ERROR: unknown vnf flavor " << flavor_id << endl;
+            return false;
+          }
+          sfc_req.vnf_flavors.push_back(flavor_id);
+          sfc_req.cpu_reqs.push_back(flavor_itr->cpu_cores);
         }
         fin >> sfc_req.bandwidth >> sfc_req.latency;
         sfc_req_set.emplace_back(sfc_req);
       }
       time_slots.emplace_back(sfc_req_set);
     }
+    if (!fin) {
+      cout << "ERROR: failed to parse timeslot file" << endl;
+      return false;
+    }
     fin.close();
     return true;
   }    
@@ -200,7 +217,7 @@ struct problem_instance {
     }
     fin.close();
     return true;
-  }*/
+  }
 };
 
 ostream& operator<<(ostream& out, const sfc_request& sfc) {
@@ -1,9 +1,14 @@
 #include <iostream>
 #include <fstream>
 #include <iterator>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <condition_variable>
 #include <sys/stat.h>
 
 #include "problem_instance.hpp"
+#include "paths_file.hpp"
 #include "iz_topology.hpp"
 #include "stop_watch.hpp"
 
@@ -17,7 +22,8 @@ string join_path(string& dir, const string& file) {
 bool write_init_topology(string& dataset_dir, 
     problem_instance& prob_inst,
     izlib::iz_topology& topo, 
-    vector<char>& node_info, vector<int>& server_ids) {
+    vector<char>& node_info, vector<int>& server_ids,
+    vector<int>& gateway_ids) {
   cout << "Generating init_topology.dat ... ";
   ofstream fout(join_path(dataset_dir, "init_topology.dat"));
   if (!fout) {
@@ -60,6 +66,8 @@ bool write_init_topology(string& dataset_dir,
         co.intra_nodes[i]->sleep_power << " " <<
         co.intra_nodes[i]->base_power << endl;
     }
+    // the backbone links end at the first switch
+    gateway_ids.push_back(id_map[co.id][0]);
     // now the servers
     for (auto i : co.server_ids) {
       id_map[co.id][i] = node_id;
@@ -110,50 +118,81 @@ bool write_init_topology(string& dataset_dir,
   return true;
 }
 
+// pairs of nodes paths.dat has paths for. The vnfs of an sfc are only
+// placed on servers, and the sfc enters and leaves at the gateways of its
+// ingress and egress cos (the core switch the backbone links end at), so
+// the paths between switches are not used.
+enum class pair_selection {
+  all,            // every pair of nodes, switches included
+  server_server,  // both ends are servers
+  gateway_server  // the server pairs and the pairs of a server and a gateway
+};
+
+bool parse_pair_selection(const string& name, pair_selection& selection) {
+  if (name == "all") selection = pair_selection::all;
+  else if (name == "server") selection = pair_selection::server_server;
+  else if (name == "gateway") selection = pair_selection::gateway_server;
+  else return false;
+  return true;
+}
+
+// every link of the merged topology goes both ways with the same latency
+// and capacity, so the paths from v to u are the paths from u to v
+// reversed. Only the pairs u < v are searched and the paths of (v, u)
+// are written right after the ones of (u, v). The pairs of each source
+// node are one task, tasks are handed out to the threads of the shared
+// pool as they become free and the searches of a thread run in its own
+// workspace. Rows are written in source order as soon as the rows before
+// them are, and a row is only started once it is at most window rows
+// ahead of the next one to write, so the paths in memory do not grow
+// with the size of the topology.
 bool write_path_link(string& dataset_dir, izlib::iz_topology& topo, 
     const vector<char>& node_info, vector<int> server_ids,
+    const vector<int>& gateway_ids,
+    pair_selection selection = pair_selection::all,
     bool use_one_path = false, int phy_k = 3) {
-  auto node_count = node_info.size();
-  izlib::iz_path_list phy_paths;
-  for (int u = 0; u < node_count; ++u) {
-    for (int v = 0; v < node_count; ++v) {
-      if (u != v
-          //node_info[u] == 'c' &&
-          //node_info[v] == 'c'
-          ) {
-        // both u and v are servers, and u != v
-        if (use_one_path) {
-          izlib::iz_path path;
-          topo.shortest_path(u, v, path);
-          phy_paths.push_back(path);
-        }
-        else {
-          izlib::iz_path_list paths;
-          topo.k_shortest_paths(u, v, phy_k, paths); 
-          phy_paths.insert(phy_paths.end(), paths.begin(), paths.end());
-        }
-      }
+  int node_count = node_info.size();
+  vector<char> is_gateway(node_count, 0);
+  for (auto id : gateway_ids) is_gateway[id] = 1;
+  auto is_selected = [&](int u, int v) {
+    bool u_server = node_info[u] == 'c', v_server = node_info[v] == 'c';
+    switch (selection) {
+      case pair_selection::all:
+        return true;
+      case pair_selection::server_server:
+        return u_server && v_server;
+      case pair_selection::gateway_server:
+        return (u_server || is_gateway[u]) && (v_server || is_gateway[v]) &&
+            (u_server || v_server);
     }
-    cout << u + 1 << "/" << node_count << " done." << '\r' << flush;
-  }
-  cout << endl;
-  cout << "total paths: " << phy_paths.size() << endl;
+    return false;
+  };
 
-  // write to file
   int server_count = server_ids.size();
   ofstream fout(join_path(dataset_dir, "paths.dat"));
-  fout << phy_paths.size() + server_count << endl;
+  if (!fout) {
+    cerr << "failed to create paths.dat file in " + dataset_dir << endl;
+    return false;
+  }
+  // the path count is only known at the end, it is written over a blank
+  // field wide enough for any count
+  const int count_width = 20;
+  fout << string(count_width, ' ') << endl;
   // insert dummy paths for in-server embedding
   for (int i = 0; i < server_ids.size(); ++i) {
     fout << i << " 2 " << server_ids[i] << " " 
         << server_ids[i] << " 0" << endl;
   }
   // now the actual paths
-  for (size_t i = 0; i < phy_paths.size(); ++i) {
+  size_t path_id = server_count;
+  vector<int> nodes, switches;
+  auto write_path = [&](const izlib::iz_path& path, bool reversed) {
+    nodes = path.nodes;
+    if (reversed) reverse(nodes.begin(), nodes.end());
     // path_switch.dat file
-    fout << server_count + i << " " << phy_paths[i].nodes.size() << " ";
-    vector<int> switches;
-    for (auto& node : phy_paths[i].nodes) {
+    fout << path_id++ << " " << nodes.size() << " ";
+    switches.clear();
+    for (auto& node : nodes) {
       fout << node << " ";
       if (node_info[node] == 's') switches.push_back(node);
     }
@@ -161,12 +200,71 @@ bool write_path_link(string& dataset_dir, izlib::iz_topology& topo,
     copy(switches.begin(), switches.end(), ostream_iterator<int>(
         fout, " "));
     fout<< endl;
-  }
+  };
+
+  auto& pool = izlib::iz_thread_pool::shared();
+  const int window = 2 * pool.thread_count();
+  // finished rows waiting for the rows before them, row u holds the
+  // paths from u to v at v - u - 1
+  map<int, vector<izlib::iz_path_list>> pending;
+  int next_row{0};
+  mutex write_mutex;
+  condition_variable write_cv;
+  pool.parallel_for(node_count, [&](int u) {
+    {
+      // rows are handed out in order, so the next row to write is
+      // already running and the wait ends
+      unique_lock<mutex> lock(write_mutex);
+      write_cv.wait(lock, [&] {return u < next_row + window;});
+    }
+    vector<izlib::iz_path_list> row(node_count - u - 1);
+    for (int v = u + 1; v < node_count; ++v) {
+      if (!is_selected(u, v)) continue;
+      auto& uv_paths = row[v - u - 1];
+      if (use_one_path) {
+        izlib::iz_path path;
+        topo.shortest_path(u, v, path);
+        uv_paths.push_back(path);
+      }
+      else {
+        topo.k_shortest_paths(u, v, phy_k, uv_paths);
+      }
+    }
+    lock_guard<mutex> lock(write_mutex);
+    pending[u].swap(row);
+    while (!pending.empty() && pending.begin()->first == next_row) {
+      for (auto& uv_paths : pending.begin()->second) {
+        for (auto& path : uv_paths) write_path(path, false);
+        for (auto& path : uv_paths) write_path(path, true);
+      }
+      pending.erase(pending.begin());
+      ++next_row;
+      cout << next_row << "/" << node_count << " done." << '\r' << flush;
+    }
+    write_cv.notify_all();
+  });
+  cout << endl;
+  cout << "total paths: " << path_id - server_count << endl;
+  fout.seekp(0);
+  fout << path_id;
   fout.close();
+  return static_cast<bool>(fout);
+}
+
+// paths.bin is the binary form of init_topology.dat and paths.dat that
+// esso_cplex.o can map instead of parsing paths.dat
+bool write_paths_binary(string& dataset_dir) {
+  cout << "Generating paths.bin ... ";
+  if (!write_paths_file(join_path(dataset_dir, "init_topology.dat"),
+      join_path(dataset_dir, "paths.dat"),
+      join_path(dataset_dir, "paths.bin"))) {
+    return false;
+  }
+  cout << "done" << endl;
   return true;
 }
 
-bool process_dataset(string& dataset_dir) {
+bool process_dataset(string& dataset_dir, pair_selection selection) {
   problem_instance prob_inst;
 
   problem_input prob_input;
@@ -178,10 +276,12 @@ bool process_dataset(string& dataset_dir) {
     // if all input files read successfully, then ...
     izlib::iz_topology topo; // holds the entire topology (inter-co + intra-co)
     vector<char> node_info; // to differentiate between server & switch
-    vector<int> server_ids;
+    vector<int> server_ids, gateway_ids;
     return write_init_topology(dataset_dir, prob_inst, topo, 
-        node_info, server_ids) &&
-      write_path_link(dataset_dir, topo, node_info, server_ids);
+        node_info, server_ids, gateway_ids) &&
+      write_path_link(dataset_dir, topo, node_info, server_ids,
+          gateway_ids, selection) &&
+      write_paths_binary(dataset_dir);
   }
   // error reading input file(s)
   return false;
@@ -190,8 +290,13 @@ bool process_dataset(string& dataset_dir) {
 int main(int argc, char**argv) {
 
   // check for the correct usage
-  if (argc != 2) {
-    cerr << "usage: ./process_topology.o <relative-path-to-dataset-dir>" << endl;
+  pair_selection selection = pair_selection::all;
+  if (argc != 2 && (argc != 4 || string(argv[2]) != "-p" ||
+      !parse_pair_selection(argv[3], selection))) {
+    cerr << "usage: ./process_topology.o <relative-path-to-dataset-dir> " <<
+        "[-p <all|server|gateway>]" << endl;
+    cerr << "  -p  pairs of nodes to write paths for: all (default), " <<
+        "servers or servers and co gateways" << endl;
     return -1;
   }
 
@@ -199,7 +304,7 @@ int main(int argc, char**argv) {
   //try to open co_topology.dat file
   stop_watch sw;
   sw.start();
-  auto result = process_dataset(dataset_dir);
+  auto result = process_dataset(dataset_dir, selection);
   sw.stop();
   cout << "time: " << sw << endl;
   if (!result) cerr << "error" << endl;
@@ -493,8 +493,21 @@ if __name__ == '__main__':
     except OSError as e:
         pass
 
-    # copy data files to the run folder
-    shutil.copy(os.path.join(dataset_path, 'paths.dat'), run_path)
+    # copy data files to the run folder, esso_cplex.o maps paths.bin
+    # instead of parsing paths.dat if process_topology.o wrote it. A
+    # paths.bin older than the text files it was built from is stale.
+    paths_filename = 'paths.dat'
+    paths_bin = os.path.join(dataset_path, 'paths.bin')
+    if os.path.exists(paths_bin):
+        sources = [os.path.join(dataset_path, 'paths.dat'),
+                   os.path.join(dataset_path, 'init_topology.dat')]
+        if all(os.path.getmtime(paths_bin) >= os.path.getmtime(f)
+               for f in sources if os.path.exists(f)):
+            paths_filename = 'paths.bin'
+        else:
+            logging.warning('paths.bin is older than paths.dat or '
+                            'init_topology.dat, using paths.dat')
+    shutil.copy(os.path.join(dataset_path, paths_filename), run_path)
     #shutil.copyfile(os.path.join(dataset_path, 'init_topology.dat'),
     #                os.path.join(run_path,'res_topology_0.dat'))
 
@@ -581,7 +594,7 @@ if __name__ == '__main__':
             with open('run.log', 'a+') as exe_log:
                 if args.cplex:
                     exe_path = './' + executable + ' ' + \
-                            topo_filename + ' paths.dat'
+                            topo_filename + ' ' + paths_filename
                 else:
                     exe_path = './' + executable + ' ' + \
                             '../' + os.path.join(dataset_path, 